@@ -0,0 +1,557 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+// Sweeps data size, index width and access pattern, comparing index_ptr
+// against raw pointers, raw indices and std::span. Passes meant for arrays
+// past the last level cache, such as prefetch_view, partitioned_gather(),
+// build_backlinks(), interleave() and address_map, are swept from
+// large_size up. Run with --json to write nanobench results for
+// bench/compare.py.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <limits>
+#include <nanobench.h>
+#include <nodecode/address_map.hpp>
+#include <nodecode/backlinks.hpp>
+#include <nodecode/index_ptr.hpp>
+#include <nodecode/interleave.hpp>
+#include <nodecode/partitioned_gather.hpp>
+#include <nodecode/prefetch.hpp>
+#include <numeric>
+#include <random>
+#include <span>
+#include <string>
+#include <vector>
+
+using namespace ankerl;
+using namespace nodecode;
+
+namespace {
+
+// Smallest size for the passes meant for arrays past the last level cache
+constexpr size_t large_size = size_t(1) << 20;
+
+struct options {
+  size_t      minSize = size_t(1) << 8;
+  size_t      maxSize = size_t(1) << 24;
+  std::string json;
+};
+
+template <class IndexType>
+std::string width_name() {
+  return "uint" + std::to_string(sizeof(IndexType) * 8);
+}
+
+// Arrays for the random and sequential sum patterns. indices and ptrs hold
+// the same values.
+template <class IndexType>
+struct SumHeader {
+  std::vector<uint32_t>                             data;
+  std::vector<IndexType>                            indices;
+  std::vector<index_ptr<&SumHeader::data, IndexType>> ptrs;
+  std::vector<const uint32_t*>                      raw;
+};
+
+// One cycle through every node in the order of a permutation
+template <class IndexType>
+struct ChainHeader {
+  struct Node {
+    uint32_t                                   value;
+    index_ptr<&ChainHeader::nodes, IndexType>  next;
+  };
+  struct RawNode {
+    uint32_t       value;
+    const RawNode* next;
+  };
+  std::vector<Node>    nodes;
+  std::vector<RawNode> rawNodes;
+};
+
+// Random index_ptr into data, for the gather style passes
+struct GatherHeader {
+  std::vector<uint32_t>                       data;
+  std::vector<index_ptr<&GatherHeader::data>> ptrs;
+};
+
+GatherHeader random_gather(size_t size) {
+  GatherHeader header;
+  header.data.resize(size);
+  header.ptrs.resize(size);
+  std::mt19937 gen(1);
+  for (auto& value : header.data)
+    value = gen() % 100;
+  for (auto& ptr : header.ptrs)
+    ptr = uint32_t(gen() % size);
+  return header;
+}
+
+uint32_t gather_sum(const GatherHeader& header) {
+  uint32_t sum = 0;
+  for (auto& ptr : header.ptrs)
+    sum += header.data[static_cast<const uint32_t&>(ptr)];
+  return sum;
+}
+
+std::vector<size_t> permutation(size_t size, bool shuffle) {
+  std::vector<size_t> result(size);
+  std::iota(result.begin(), result.end(), size_t(0));
+  if (shuffle)
+    std::shuffle(result.begin(), result.end(), std::mt19937(42));
+  return result;
+}
+
+nanobench::Bench make_bench(const std::string& title, size_t batch) {
+  nanobench::Bench bench;
+  bench.title(title)
+      .unit("deref")
+      .batch(batch)
+      .relative(true)
+      .minEpochTime(std::chrono::milliseconds(10));
+  return bench;
+}
+
+template <class IndexType>
+void bench_sum(std::vector<nanobench::Bench>& results, size_t size,
+               bool random) {
+  SumHeader<IndexType> header;
+  header.data.resize(size);
+  std::mt19937 gen(1);
+  for (auto& value : header.data)
+    value = gen() % 100;
+  auto order = permutation(size, random);
+  header.indices.assign(order.begin(), order.end());
+  header.ptrs.assign(header.indices.begin(), header.indices.end());
+  for (auto index : order)
+    header.raw.push_back(&header.data[index]);
+
+  auto bench = make_bench(std::string(random ? "random" : "sequential") +
+                              " sum " + width_name<IndexType>() + " " +
+                              std::to_string(size),
+                          size);
+  uint32_t expected = std::accumulate(header.data.begin(), header.data.end(), 0u);
+  auto     check    = [&](uint32_t sum) {
+    if (sum != expected) {
+      std::cerr << "Wrong sum in " << bench.title() << "\n";
+      std::exit(EXIT_FAILURE);
+    }
+  };
+
+  if (!random) {
+    bench.run("std::span", [&] {
+      uint32_t sum = 0;
+      for (auto value : std::span(header.data))
+        sum += value;
+      nanobench::doNotOptimizeAway(sum);
+      check(sum);
+    });
+  }
+  bench.run("raw pointer", [&] {
+    uint32_t sum = 0;
+    for (auto* pointer : header.raw)
+      sum += *pointer;
+    nanobench::doNotOptimizeAway(sum);
+    check(sum);
+  });
+  bench.run("raw index", [&] {
+    uint32_t sum = 0;
+    for (auto index : header.indices)
+      sum += header.data[index];
+    nanobench::doNotOptimizeAway(sum);
+    check(sum);
+  });
+  bench.run("index_ptr bind(header)", [&] {
+    uint32_t sum = 0;
+    for (auto& ptr : header.ptrs)
+      sum += *ptr.bind(header);
+    nanobench::doNotOptimizeAway(sum);
+    check(sum);
+  });
+  bench.run("index_ptr bound_view", [&] {
+    bound_view<&SumHeader<IndexType>::data> view(header);
+    uint32_t sum = 0;
+    for (auto& ptr : header.ptrs)
+      sum += view[ptr];
+    nanobench::doNotOptimizeAway(sum);
+    check(sum);
+  });
+  bench.run("index_ptr bound_header", [&] {
+    bound_header bound(header);
+    uint32_t     sum = 0;
+    for (auto& ptr : header.ptrs)
+      sum += *ptr;
+    nanobench::doNotOptimizeAway(sum);
+    check(sum);
+  });
+  results.push_back(bench);
+}
+
+template <class IndexType>
+void bench_chain(std::vector<nanobench::Bench>& results, size_t size) {
+  using header_type = ChainHeader<IndexType>;
+  header_type header;
+  header.nodes.resize(size);
+  header.rawNodes.resize(size);
+  auto     order    = permutation(size, true);
+  uint32_t expected = 0;
+  for (size_t i = 0; i < size; ++i) {
+    uint32_t value = uint32_t(i % 100);
+    size_t   next  = order[(i + 1) % size];
+    header.nodes[order[i]]    = {value, IndexType(next)};
+    header.rawNodes[order[i]] = {value, &header.rawNodes[next]};
+    expected += value;
+  }
+
+  auto bench = make_bench("chain " + width_name<IndexType>() + " " +
+                              std::to_string(size),
+                          size);
+  auto check = [&](uint32_t sum) {
+    if (sum != expected) {
+      std::cerr << "Wrong sum in " << bench.title() << "\n";
+      std::exit(EXIT_FAILURE);
+    }
+  };
+
+  bench.run("raw pointer", [&] {
+    uint32_t    sum  = 0;
+    const auto* node = &header.rawNodes[order[0]];
+    for (size_t i = 0; i < size; ++i) {
+      sum += node->value;
+      node = node->next;
+    }
+    nanobench::doNotOptimizeAway(sum);
+    check(sum);
+  });
+  bench.run("raw index", [&] {
+    uint32_t sum   = 0;
+    size_t   index = order[0];
+    for (size_t i = 0; i < size; ++i) {
+      sum += header.nodes[index].value;
+      index = static_cast<const IndexType&>(header.nodes[index].next);
+    }
+    nanobench::doNotOptimizeAway(sum);
+    check(sum);
+  });
+  bench.run("index_ptr bind(header)", [&] {
+    uint32_t sum  = 0;
+    auto*    node = &header.nodes[order[0]];
+    for (size_t i = 0; i < size; ++i) {
+      sum += node->value;
+      node = &*node->next.bind(header);
+    }
+    nanobench::doNotOptimizeAway(sum);
+    check(sum);
+  });
+  bench.run("index_ptr bound_view", [&] {
+    bound_view<&header_type::nodes> view(header);
+    uint32_t sum  = 0;
+    auto*    node = &header.nodes[order[0]];
+    for (size_t i = 0; i < size; ++i) {
+      sum += node->value;
+      node = &view[node->next];
+    }
+    nanobench::doNotOptimizeAway(sum);
+    check(sum);
+  });
+  bench.run("index_ptr bound_header", [&] {
+    bound_header bound(header);
+    uint32_t     sum  = 0;
+    auto*        node = &header.nodes[order[0]];
+    for (size_t i = 0; i < size; ++i) {
+      sum += node->value;
+      node = &*node->next;
+    }
+    nanobench::doNotOptimizeAway(sum);
+    check(sum);
+  });
+  results.push_back(bench);
+}
+
+void bench_prefetch(std::vector<nanobench::Bench>& results, size_t size) {
+  GatherHeader header   = random_gather(size);
+  uint32_t     expected = gather_sum(header);
+  auto bench = make_bench("prefetch " + std::to_string(size), size);
+  auto check = [&](uint32_t sum) {
+    if (sum != expected) {
+      std::cerr << "Wrong sum in " << bench.title() << "\n";
+      std::exit(EXIT_FAILURE);
+    }
+  };
+
+  bench.run("index_ptr bind(header)", [&] {
+    uint32_t sum = 0;
+    for (auto& ptr : header.ptrs)
+      sum += *ptr.bind(header);
+    nanobench::doNotOptimizeAway(sum);
+    check(sum);
+  });
+  for (size_t distance : {16, 64, 256}) {
+    bench.run("prefetch_view distance " + std::to_string(distance), [&] {
+      uint32_t sum = 0;
+      for (auto value : prefetch_view(header.ptrs, header, distance))
+        sum += value;
+      nanobench::doNotOptimizeAway(sum);
+      check(sum);
+    });
+  }
+  results.push_back(bench);
+}
+
+void bench_partitioned_gather(std::vector<nanobench::Bench>& results,
+                              size_t                         size) {
+  GatherHeader          header   = random_gather(size);
+  uint32_t              expected = gather_sum(header);
+  std::vector<uint32_t> out(size);
+  auto bench = make_bench("partitioned_gather " + std::to_string(size), size);
+  auto check = [&](uint32_t sum) {
+    if (sum != expected) {
+      std::cerr << "Wrong sum in " << bench.title() << "\n";
+      std::exit(EXIT_FAILURE);
+    }
+  };
+
+  bench.run("index_ptr bind(header)", [&] {
+    uint32_t sum = 0;
+    for (auto& ptr : header.ptrs)
+      sum += *ptr.bind(header);
+    nanobench::doNotOptimizeAway(sum);
+    check(sum);
+  });
+  bench.run("partitioned_gather then sum", [&] {
+    partitioned_gather(header.ptrs, header, out);
+    uint32_t sum = std::accumulate(out.begin(), out.end(), 0u);
+    nanobench::doNotOptimizeAway(sum);
+    check(sum);
+  });
+  results.push_back(bench);
+}
+
+// size random edges between size / 8 nodes
+struct GraphHeader {
+  std::vector<uint32_t>                            nodes;
+  std::vector<index_ptr<&GraphHeader::nodes>>      edges;
+  std::vector<index_ptr<&GraphHeader::edges>>      backlinks;
+  std::vector<index_span<&GraphHeader::backlinks>> incoming;
+};
+
+void bench_backlinks(std::vector<nanobench::Bench>& results, size_t size) {
+  GraphHeader header;
+  header.nodes.resize(size / 8);
+  header.edges.resize(size);
+  std::mt19937 gen(1);
+  for (auto& edge : header.edges)
+    edge = uint32_t(gen() % header.nodes.size());
+
+  auto bench = make_bench("backlinks " + std::to_string(size), size);
+  bench.unit("edge");
+  // Copying the edges is a lower bound on any pass over them
+  std::vector<index_ptr<&GraphHeader::nodes>> copy(size);
+  bench.run("copy edges", [&] {
+    std::ranges::copy(header.edges, copy.begin());
+    nanobench::doNotOptimizeAway(copy[size / 2]);
+  });
+  bench.run("build_backlinks", [&] {
+    build_backlinks<index_refs<&GraphHeader::edges>, &GraphHeader::backlinks,
+                    index_refs<&GraphHeader::incoming>>(header);
+    nanobench::doNotOptimizeAway(header.incoming[0]);
+    if (header.backlinks.size() != size) {
+      std::cerr << "Wrong backlink count in " << bench.title() << "\n";
+      std::exit(EXIT_FAILURE);
+    }
+  });
+  results.push_back(bench);
+}
+
+// Random walks over a graph with one random successor per node
+struct WalkNode;
+struct WalkHeader {
+  std::vector<WalkNode> nodes;
+};
+struct WalkNode {
+  uint32_t                      value;
+  index_ptr<&WalkHeader::nodes> next;
+};
+
+interleaved_task walk(WalkHeader& header, index_ptr<&WalkHeader::nodes> node,
+                      int hops, uint32_t& sum) {
+  for (int i = 0; i < hops; ++i) {
+    const WalkNode& n = co_await fetch(node, header);
+    sum += n.value;
+    node = n.next;
+  }
+}
+
+void bench_interleave(std::vector<nanobench::Bench>& results, size_t size) {
+  constexpr size_t walks = 100000;
+  constexpr int    hops  = 20;
+  WalkHeader       header;
+  header.nodes.resize(size);
+  std::mt19937 gen(1);
+  for (auto& node : header.nodes)
+    node = {uint32_t(gen() % 100), uint32_t(gen() % size)};
+  auto start = [&](size_t w) { return uint32_t(w * 7919 % size); };
+
+  uint32_t expected = 0;
+  for (size_t w = 0; w < walks; ++w) {
+    index_ptr<&WalkHeader::nodes> node(start(w));
+    for (int i = 0; i < hops; ++i) {
+      const WalkNode& n = *node.bind(header);
+      expected += n.value;
+      node = n.next;
+    }
+  }
+  auto bench = make_bench("interleave " + std::to_string(size), walks * hops);
+  auto check = [&](uint32_t sum) {
+    if (sum != expected) {
+      std::cerr << "Wrong sum in " << bench.title() << "\n";
+      std::exit(EXIT_FAILURE);
+    }
+  };
+
+  bench.run("serial chains", [&] {
+    uint32_t sum = 0;
+    for (size_t w = 0; w < walks; ++w) {
+      index_ptr<&WalkHeader::nodes> node(start(w));
+      for (int i = 0; i < hops; ++i) {
+        const WalkNode& n = *node.bind(header);
+        sum += n.value;
+        node = n.next;
+      }
+    }
+    nanobench::doNotOptimizeAway(sum);
+    check(sum);
+  });
+  for (size_t group : {8, 16, 32}) {
+    bench.run("interleave group " + std::to_string(group), [&] {
+      uint32_t sum = 0;
+      interleave(
+          walks, [&](size_t w) { return walk(header, start(w), hops, sum); },
+          group);
+      nanobench::doNotOptimizeAway(sum);
+      check(sum);
+    });
+  }
+  results.push_back(bench);
+}
+
+// A pointer based graph in separate allocations, and its converted form
+struct PointerNode {
+  uint32_t     value;
+  PointerNode* next;
+};
+struct ConvertedNode;
+struct ConvertedHeader {
+  std::vector<ConvertedNode> nodes;
+};
+struct ConvertedNode {
+  uint32_t                           value;
+  index_ptr<&ConvertedHeader::nodes> next;
+};
+
+void bench_convert(std::vector<nanobench::Bench>& results, size_t size) {
+  // Listed in an order unrelated to their addresses
+  std::vector<std::unique_ptr<PointerNode>> nodes(size);
+  for (auto& node : nodes)
+    node = std::make_unique<PointerNode>();
+  std::mt19937 gen(1);
+  for (size_t i = 0; i < size; ++i)
+    *nodes[i] = {uint32_t(i), nodes[gen() % size].get()};
+  std::shuffle(nodes.begin(), nodes.end(), gen);
+
+  auto bench = make_bench("convert graph " + std::to_string(size), size);
+  bench.unit("node");
+  std::unique_ptr<address_map<PointerNode>> map;
+  bench.run("address_map", [&] {
+    map = std::make_unique<address_map<PointerNode>>(nodes);
+    nanobench::doNotOptimizeAway(map->size());
+  });
+  ConvertedHeader header;
+  bench.run("convert_objects", [&] {
+    convert_objects<&ConvertedHeader::nodes>(
+        header, nodes, [&](const PointerNode& node) {
+          return ConvertedNode{
+              node.value,
+              map->to_index_ptr<&ConvertedHeader::nodes>(node.next)};
+        });
+    nanobench::doNotOptimizeAway(header.nodes[0]);
+  });
+  for (size_t i = 0; i < size; ++i) {
+    if (header.nodes[i].next.bind(header)->value != nodes[i]->next->value) {
+      std::cerr << "Wrong conversion in " << bench.title() << "\n";
+      std::exit(EXIT_FAILURE);
+    }
+  }
+  results.push_back(bench);
+}
+
+// Widths too narrow to address every object are skipped
+template <class IndexType>
+void bench_width(std::vector<nanobench::Bench>& results, size_t size) {
+  if (size - 1 > std::numeric_limits<IndexType>::max())
+    return;
+  bench_sum<IndexType>(results, size, false);
+  bench_sum<IndexType>(results, size, true);
+  bench_chain<IndexType>(results, size);
+}
+
+options parse(int argc, char** argv) {
+  options result;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--json" && i + 1 < argc)
+      result.json = argv[++i];
+    else if (arg == "--min-size" && i + 1 < argc)
+      result.minSize = std::stoull(argv[++i]);
+    else if (arg == "--max-size" && i + 1 < argc)
+      result.maxSize = std::stoull(argv[++i]);
+    else if (arg == "--quick")
+      result.maxSize = size_t(1) << 20;
+    else {
+      std::cerr << "Usage: " << argv[0]
+                << " [--json results.json] [--min-size N] [--max-size N]"
+                   " [--quick]\n";
+      std::exit(arg == "--help" ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+  }
+  return result;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  options                       opts = parse(argc, argv);
+  std::vector<nanobench::Bench> results;
+  // Sizes go up by 4x, from L1 resident to well past the last level cache
+  for (size_t size = opts.minSize; size <= opts.maxSize; size *= 4) {
+    bench_width<uint8_t>(results, size);
+    bench_width<uint16_t>(results, size);
+    bench_width<uint32_t>(results, size);
+    bench_width<uint64_t>(results, size);
+  }
+  for (size_t size = std::max(opts.minSize, large_size); size <= opts.maxSize;
+       size *= 4) {
+    bench_prefetch(results, size);
+    bench_partitioned_gather(results, size);
+    bench_backlinks(results, size);
+    bench_interleave(results, size);
+    bench_convert(results, size);
+  }
+  if (!opts.json.empty()) {
+    std::ofstream file(opts.json);
+    file << "[\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+      results[i].render(nanobench::templates::json(), file);
+      file << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    file << "]\n";
+    if (!file) {
+      std::cerr << "Failed to write " << opts.json << "\n";
+      return EXIT_FAILURE;
+    }
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,56 @@
+#!/usr/bin/env python3
+# Copyright (c) 2024 Pyarelal Knowles, MIT License
+"""Compares two index_ptr_bench --json outputs and flags regressions.
+
+Usage: compare.py baseline.json current.json [--threshold 0.1]
+
+Exits with status 1 if any benchmark present in both files got slower by
+more than the threshold, as a fraction of the baseline median.
+"""
+
+import argparse
+import json
+import sys
+
+
+def load(path):
+    with open(path) as f:
+        data = json.load(f)
+    if isinstance(data, dict):
+        data = [data]
+    results = {}
+    for bench in data:
+        for result in bench["results"]:
+            key = (result["title"], result["name"])
+            results[key] = result["median(elapsed)"] / result["batch"]
+    return results
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("baseline")
+    parser.add_argument("current")
+    parser.add_argument("--threshold", type=float, default=0.1)
+    args = parser.parse_args()
+
+    baseline = load(args.baseline)
+    current = load(args.current)
+    regressions = 0
+    for key in sorted(baseline.keys() & current.keys()):
+        before, after = baseline[key], current[key]
+        change = after / before - 1.0 if before > 0 else 0.0
+        flag = ""
+        if change > args.threshold:
+            flag = "  REGRESSION"
+            regressions += 1
+        print(f"{key[0]:<32} {key[1]:<26} {before * 1e9:9.3f}ns "
+              f"{after * 1e9:9.3f}ns {change * 100:+7.1f}%{flag}")
+    for key in sorted(baseline.keys() ^ current.keys()):
+        print(f"{key[0]:<32} {key[1]:<26} only in "
+              f"{'baseline' if key in baseline else 'current'}")
+    print(f"{regressions} regression(s) over {args.threshold * 100:.0f}%")
+    return 1 if regressions else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
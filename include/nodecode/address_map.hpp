@@ -0,0 +1,254 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <nodecode/index_ptr.hpp>
+#include <nodecode/parallel.hpp>
+#include <ranges>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace nodecode {
+
+namespace address_map_detail {
+
+// Elements of a source range may be objects, raw pointers or smart pointers
+template <class Element>
+const auto& source_of(const Element& element) {
+  if constexpr (std::is_pointer_v<Element>)
+    return *element;
+  else if constexpr (requires { *element.get(); })
+    return *element.get();
+  else
+    return element;
+}
+
+// Address of the object an element refers to. A null pointer refers to
+// none, and its address would read as an empty table slot.
+template <class Element>
+uintptr_t address_of(const Element& element) {
+  if constexpr (std::is_pointer_v<Element> ||
+                requires { *element.get(); }) {
+    if (element == nullptr)
+      throw std::invalid_argument("Null pointer in address_map sources");
+  }
+  return reinterpret_cast<uintptr_t>(std::addressof(source_of(element)));
+}
+
+// Entries are partitioned by the top bits of their hash into blocks, each
+// with its own region of the table, so blocks are filled in parallel
+inline constexpr unsigned block_bits = 8;
+inline constexpr size_t   max_blocks = size_t(1) << block_bits;
+
+// Spreads addresses, which share their high bits and alignment, over all
+// 64 bits
+constexpr uint64_t mix(uint64_t h) {
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdull;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ull;
+  h ^= h >> 33;
+  return h;
+}
+
+// parallel_for_each() binds a header; address_map works without one
+struct unbound {};
+
+} // namespace address_map_detail
+
+// Finds the position of each object of a pointer based graph from its
+// address, so pointers between objects can be rewritten as indices once
+// the objects are copied into a Header. Built from a range of the objects,
+// or raw or smart pointers to them, in the order they will be stored.
+// Throws std::invalid_argument for null pointers or repeated objects.
+// Addresses go in an open addressing hash table, 2/3 full, so a find() is
+// usually one cache miss. Entries are radix partitioned by hash into blocks
+// that each fill their own region of the table, all in parallel and
+// without atomics.
+template <class T>
+class address_map {
+public:
+  static constexpr size_t npos = std::numeric_limits<size_t>::max();
+
+  template <std::ranges::random_access_range Range>
+    requires std::ranges::sized_range<Range>
+  explicit address_map(
+      const Range& objects, size_t chunkSize = default_parallel_chunk,
+      size_t threadCount = std::thread::hardware_concurrency()) {
+    using namespace address_map_detail;
+    m_size = std::ranges::size(objects);
+    if (!m_size)
+      return;
+    threadCount   = std::max(threadCount, size_t(1));
+    chunkSize     = std::max(chunkSize, size_t(1));
+    auto   first  = std::ranges::begin(objects);
+    size_t chunks = (m_size + chunkSize - 1) / chunkSize;
+    unbound header;
+    auto    forChunk = [&](size_t chunk, auto&& fn) {
+      size_t end = std::min((chunk + 1) * chunkSize, m_size);
+      for (size_t i = chunk * chunkSize; i < end; ++i) {
+        uintptr_t a = address_of(first[ptrdiff_t(i)]);
+        fn(i, a, mix(a));
+      }
+    };
+
+    radix_partition partition(
+        header, chunks, max_blocks,
+        [&](size_t chunk, auto&& add) {
+          forChunk(chunk,
+                   [&](size_t, uintptr_t, uint64_t h) { add(block_of(h)); });
+        },
+        threadCount);
+    // Not value initialized; every element is written before it is read
+    std::unique_ptr<entry[]> partitioned(new entry[m_size]);
+    partition.scatter(header, [&](size_t chunk, auto&& next) {
+      forChunk(chunk, [&](size_t i, uintptr_t a, uint64_t h) {
+        partitioned[next(block_of(h))] = {a, i};
+      });
+    });
+
+    size_t slots = 0;
+    for (size_t b = 0; b < max_blocks; ++b) {
+      size_t count = partition.end(b) - partition.begin(b);
+      m_regions[b] = {slots, count + count / 2 + 1};
+      slots += m_regions[b].size;
+    }
+    m_table.reset(new entry[slots]);
+    parallel_for_each(
+        header, std::views::iota(size_t(0), max_blocks),
+        [&](size_t b) {
+          size_t capacity = m_regions[b].size;
+          entry* table    = m_table.get() + m_regions[b].begin;
+          std::fill(table, table + capacity, entry{empty, 0});
+          for (size_t k = partition.begin(b); k < partition.end(b); ++k) {
+            const entry& e    = partitioned[k];
+            size_t       slot = slot_of(mix(e.address), capacity);
+            for (; table[slot].address != empty;
+                 slot = slot + 1 == capacity ? 0 : slot + 1)
+              if (table[slot].address == e.address)
+                throw std::invalid_argument("Object is listed twice");
+            table[slot] = e;
+          }
+        },
+        1, threadCount);
+  }
+
+  size_t size() const { return m_size; }
+
+  // Position of the object at pointer, or npos if it was not given
+  size_t find(const T* pointer) const {
+    uintptr_t a = address(pointer);
+    if (!m_size || a == empty)
+      return npos;
+    uint64_t      h     = address_map_detail::mix(a);
+    const region& r     = m_regions[block_of(h)];
+    const entry*  table = m_table.get() + r.begin;
+    for (size_t slot = slot_of(h, r.size); table[slot].address != empty;
+         slot        = slot + 1 == r.size ? 0 : slot + 1)
+      if (table[slot].address == a)
+        return table[slot].index;
+    return npos;
+  }
+  // The index_ptr for pointer. Throws if the object was not given or its
+  // position does not fit IndexType. Null pointers have no index, so handle
+  // them before calling this.
+  template <auto ObjectsPtr, class IndexType = uint32_t>
+  index_ptr<ObjectsPtr, IndexType> to_index_ptr(const T* pointer) const {
+    return checked<IndexType>(find(pointer));
+  }
+
+  // The index_span for count objects starting at first, e.g. an array of
+  // children. Only the ends are looked up, so the objects must have been
+  // given consecutively in the same order, as they are when listing every
+  // element of each source array in turn. Throws std::out_of_range if the
+  // span would run past the last object given.
+  template <auto ObjectsPtr, class IndexType = uint32_t,
+            class SizeType = IndexType>
+  index_span<ObjectsPtr, IndexType, false, SizeType>
+  to_index_span(const T* first, size_t count) const {
+    if (!count)
+      return {};
+    size_t index = find(first);
+    if (index != npos && count > m_size - index)
+      throw std::out_of_range("Span runs past the end of address_map");
+    if (index != npos && find(first + (count - 1)) != index + (count - 1))
+      throw std::invalid_argument("Objects are not stored consecutively");
+    if (count > size_t(std::numeric_limits<SizeType>::max()))
+      throw std::out_of_range("Span does not fit SizeType");
+    return {checked<IndexType>(index), SizeType(count)};
+  }
+
+private:
+  struct entry {
+    uintptr_t address;
+    size_t    index;
+  };
+  struct region {
+    size_t begin = 0;
+    size_t size  = 0;
+  };
+
+  // Null is never an object's address
+  static constexpr uintptr_t empty = 0;
+
+  static uintptr_t address(const T* pointer) {
+    return reinterpret_cast<uintptr_t>(pointer);
+  }
+  static size_t block_of(uint64_t h) {
+    return size_t(h >> (64 - address_map_detail::block_bits));
+  }
+  // The low 32 bits of the hash scaled to the region, independent of the
+  // block bits
+  static size_t slot_of(uint64_t h, size_t size) {
+    return size_t(((h & 0xffffffffull) * size) >> 32);
+  }
+  template <class IndexType>
+  static IndexType checked(size_t index) {
+    if (index == npos)
+      throw std::out_of_range("Pointer is not in address_map");
+    if (index > size_t(std::numeric_limits<IndexType>::max()))
+      throw std::out_of_range("Index does not fit IndexType");
+    return IndexType(index);
+  }
+
+  // Not value initialized; the constructor fills every slot
+  std::unique_ptr<entry[]>                           m_table;
+  size_t                                             m_size = 0;
+  std::array<region, address_map_detail::max_blocks> m_regions;
+};
+
+// Fills header.*ObjectsPtr, a std::vector or similar, with convert(source)
+// for each object of sources, in parallel with header bound. sources is the
+// range given to address_map, so element i lands at index i and convert
+// can rewrite pointer fields with address_map::to_index_ptr(). Targets are
+// default constructed, then assigned. The result can be written with
+// write_file() and mapped back as is.
+template <auto ObjectsPtr, class Header,
+          std::ranges::random_access_range Range, class Convert>
+  requires std::ranges::sized_range<Range>
+void convert_objects(Header& header, const Range& sources, Convert&& convert,
+                     size_t chunkSize   = default_parallel_chunk,
+                     size_t threadCount = std::thread::hardware_concurrency()) {
+  auto&  objects = header.*ObjectsPtr;
+  size_t size    = std::ranges::size(sources);
+  objects.resize(size);
+  auto out   = std::ranges::begin(objects);
+  auto first = std::ranges::begin(sources);
+  parallel_for_each(
+      header, std::views::iota(size_t(0), size),
+      [&](size_t i) {
+        out[ptrdiff_t(i)] =
+            convert(address_map_detail::source_of(first[ptrdiff_t(i)]));
+      },
+      chunkSize, threadCount);
+}
+
+} // namespace nodecode
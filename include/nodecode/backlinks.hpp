@@ -0,0 +1,198 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <memory>
+#include <nodecode/index_ptr.hpp>
+#include <nodecode/parallel.hpp>
+#include <ranges>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace nodecode {
+
+namespace backlinks_detail {
+
+// Calls fn(target) for each object ref refers to, throwing if any is past
+// targetCount
+template <class Ref, class Fn>
+void for_each_target(const Ref& ref, size_t targetCount, Fn&& fn) {
+  using index_type = typename Ref::index_type;
+  if constexpr (is_index_ptr_v<Ref>) {
+    size_t target = static_cast<const index_type&>(ref);
+    if (target >= targetCount)
+      throw std::out_of_range("index_ptr out of range");
+    fn(target);
+  } else {
+    size_t index = ref.index(), size = ref.size();
+    if (index > targetCount || size > targetCount - index)
+      throw std::out_of_range("index_span out of range");
+    for (size_t target = index; target < index + size; ++target)
+      fn(target);
+  }
+}
+
+// Referenced objects are split into at most max_blocks blocks of at least
+// 2^min_block_bits. Each block is one write stream while partitioning, and
+// its counters are what should stay in cache while it is scattered.
+inline constexpr size_t   max_blocks     = 256;
+inline constexpr unsigned min_block_bits = 12;
+
+template <class TargetIndex, class SourceIndex>
+struct reference {
+  TargetIndex target;
+  SourceIndex source;
+};
+
+template <class Refs>
+struct refs_traits;
+template <auto ArrayPtr, auto... MemberPtr>
+struct refs_traits<index_refs<ArrayPtr, MemberPtr...>> {
+  static constexpr auto array_ptr = ArrayPtr;
+  template <class Element>
+  static decltype(auto) ref(Element& element) {
+    return ref_of<MemberPtr...>(element);
+  }
+};
+
+} // namespace backlinks_detail
+
+// Inverts the references named by Refs, an index_refs<> to index_ptr or
+// index_span objects, into compressed sparse rows. header.*BacklinksPtr, a
+// vector of index_ptr to the elements of Refs' array, is filled with the
+// referring elements grouped by the object they refer to, each group in
+// ascending order. Spans, an index_refs<> to one index_span into
+// header.*BacklinksPtr per referenced object, is set to each group: either
+// a separate vector, resized to match, or a member of every referenced
+// object. References are first radix partitioned by block of referenced
+// objects, then each block is counted, prefix summed and scattered while
+// its counters are in cache. Every pass is parallel and none needs atomics.
+// Everything that can throw is checked before the header is modified.
+template <class Refs, auto BacklinksPtr, class Spans, class Header>
+void build_backlinks(Header& header, size_t chunkSize = default_parallel_chunk,
+                     size_t threadCount = std::thread::hardware_concurrency()) {
+  using namespace backlinks_detail;
+  using refs        = refs_traits<Refs>;
+  using spans       = refs_traits<Spans>;
+  auto& sources     = header.*refs::array_ptr;
+  using source_type = std::remove_reference_t<
+      std::ranges::range_reference_t<decltype(sources)>>;
+  using ref_type = std::remove_cvref_t<decltype(refs::ref(
+      std::declval<const source_type&>()))>;
+  static_assert(is_index_ptr_v<ref_type> || is_index_span_v<ref_type>,
+                "index_refs must name index_ptr or index_span objects");
+  auto& backlinks = header.*BacklinksPtr;
+  using backlink_type =
+      typename std::remove_cvref_t<decltype(backlinks)>::value_type;
+  using source_index = typename backlink_type::index_type;
+  static_assert(is_index_ptr_v<backlink_type> &&
+                    same_member<backlink_type::objects_ptr, refs::array_ptr>(),
+                "backlinks must be index_ptrs to the referring array");
+  auto& targets     = header.*ref_type::objects_ptr;
+  auto& spanArray   = header.*spans::array_ptr;
+  using span_holder = std::remove_reference_t<
+      std::ranges::range_reference_t<decltype(spanArray)>>;
+  using span_type =
+      std::remove_cvref_t<decltype(spans::ref(std::declval<span_holder&>()))>;
+  static_assert(is_index_span_v<span_type> &&
+                    same_member<span_type::objects_ptr, BacklinksPtr>(),
+                "Spans must name index_spans into the backlinks");
+
+  size_t sourceCount = std::ranges::size(sources);
+  size_t targetCount = std::ranges::size(targets);
+  constexpr bool resizeSpans =
+      !same_member<spans::array_ptr, ref_type::objects_ptr>() &&
+      requires { spanArray.resize(targetCount); };
+  if (!resizeSpans && std::ranges::size(spanArray) != targetCount)
+    throw std::invalid_argument("Spans must have one entry per target");
+  if (sourceCount &&
+      sourceCount - 1 > size_t(std::numeric_limits<source_index>::max()))
+    throw std::out_of_range("Too many referring elements for backlink index");
+  threadCount = std::max(threadCount, size_t(1));
+  chunkSize   = std::max(chunkSize, size_t(1));
+  auto first  = std::ranges::begin(sources);
+
+  // Block of target t is t >> shift
+  unsigned shift = min_block_bits;
+  while ((targetCount >> shift) + 1 > max_blocks)
+    ++shift;
+  size_t blocks = (targetCount >> shift) + 1;
+  size_t chunks = (sourceCount + chunkSize - 1) / chunkSize;
+  auto   forChunkSources = [&](size_t chunk, auto&& fn) {
+    size_t end = std::min((chunk + 1) * chunkSize, sourceCount);
+    for (size_t i = chunk * chunkSize; i < end; ++i)
+      for_each_target(refs::ref(first[ptrdiff_t(i)]), targetCount,
+                      [&](size_t target) { fn(i, target); });
+  };
+
+  // Each block's references stay in source order
+  radix_partition partition(
+      header, chunks, blocks,
+      [&](size_t chunk, auto&& add) {
+        forChunkSources(chunk,
+                        [&](size_t, size_t target) { add(target >> shift); });
+      },
+      threadCount);
+  size_t total = partition.size();
+  if (total > size_t(std::numeric_limits<typename span_type::index_type>::max()))
+    throw std::out_of_range("Too many backlinks for index_span");
+
+  // Not value initialized; every element is written before it is read
+  using reference_type =
+      reference<typename ref_type::index_type, source_index>;
+  std::unique_ptr<reference_type[]> partitioned(new reference_type[total]);
+  partition.scatter(header, [&](size_t chunk, auto&& next) {
+    forChunkSources(chunk, [&](size_t source, size_t target) {
+      partitioned[next(target >> shift)] = {
+          typename ref_type::index_type(target), source_index(source)};
+    });
+  });
+
+  // Count per target, a block at a time while its counters are in cache.
+  // Every check is done here, before the header is touched.
+  std::vector<size_t> cursor(targetCount);
+  auto                forEachBlock = [&](auto&& fn) {
+    parallel_for_each(header, std::views::iota(size_t(0), blocks), fn, 1,
+                      threadCount);
+  };
+  forEachBlock([&](size_t b) {
+    for (size_t k = partition.begin(b); k < partition.end(b); ++k)
+      ++cursor[partitioned[k].target];
+    size_t endTarget = std::min((b + 1) << shift, targetCount);
+    for (size_t t = b << shift; t < endTarget; ++t)
+      if (cursor[t] >
+          size_t(std::numeric_limits<typename span_type::size_type>::max()))
+        throw std::out_of_range("Too many backlinks for index_span size");
+  });
+
+  // Within a block: prefix sum into spans, then scatter
+  if constexpr (resizeSpans)
+    spanArray.resize(targetCount);
+  backlinks.resize(total);
+  auto out       = std::ranges::begin(backlinks);
+  auto spanFirst = std::ranges::begin(spanArray);
+  forEachBlock([&](size_t b) {
+    size_t endTarget = std::min((b + 1) << shift, targetCount);
+    size_t next      = partition.begin(b);
+    for (size_t t = b << shift; t < endTarget; ++t) {
+      size_t count = cursor[t];
+      spans::ref(spanFirst[ptrdiff_t(t)]) =
+          span_type(typename span_type::index_type(next),
+                    typename span_type::size_type(count));
+      cursor[t] = next;
+      next += count;
+    }
+    for (size_t k = partition.begin(b); k < partition.end(b); ++k) {
+      auto& ref = partitioned[k];
+      out[ptrdiff_t(cursor[ref.target]++)] = backlink_type(ref.source);
+    }
+  });
+}
+
+} // namespace nodecode
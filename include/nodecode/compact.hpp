@@ -0,0 +1,143 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#pragma once
+
+#include <cstddef>
+#include <limits>
+#include <nodecode/index_ptr.hpp>
+#include <nodecode/parallel.hpp>
+#include <nodecode/relayout.hpp>
+#include <ranges>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace nodecode {
+
+// Entry compact() returns for objects it removed
+inline constexpr size_t removed_index = relayout_detail::removed_index;
+
+// Allocates objects of header.*ObjectsPtr, a std::vector or similar,
+// reusing slots freed by erase() before growing the array. Freed slots are
+// reused most recently freed first, while likely still in cache. Objects
+// appended to the array directly are picked up as live.
+template <auto ObjectsPtr, class IndexType = uint32_t>
+class slot_allocator {
+public:
+  using pointer_type = index_ptr<ObjectsPtr, IndexType>;
+  using header_type  = typename pointer_type::header_type;
+  using value_type   = typename pointer_type::value_type;
+
+  template <class... Args>
+  pointer_type emplace(header_type& header, Args&&... args) {
+    auto& objects = header.*ObjectsPtr;
+    sync(objects);
+    if (!m_free.empty()) {
+      IndexType index = m_free.back();
+      std::ranges::begin(objects)[index] =
+          value_type(std::forward<Args>(args)...);
+      m_free.pop_back();
+      m_removed[index] = false;
+      return index;
+    }
+    size_t index = m_removed.size();
+    if (index > size_t(std::numeric_limits<IndexType>::max()))
+      throw std::out_of_range("Array is full for IndexType");
+    objects.emplace_back(std::forward<Args>(args)...);
+    m_removed.push_back(false);
+    return IndexType(index);
+  }
+
+  // Frees the slot of ptr for reuse. The object is reset to a default
+  // constructed value so it releases anything it owns.
+  void erase(header_type& header, const pointer_type& ptr) {
+    auto& objects = header.*ObjectsPtr;
+    sync(objects);
+    size_t index = static_cast<const IndexType&>(ptr);
+    if (index >= m_removed.size())
+      throw std::out_of_range("index_ptr out of range");
+    if (m_removed[index])
+      throw std::invalid_argument("Slot is already free");
+    m_free.reserve(m_free.size() + 1);
+    std::ranges::begin(objects)[index] = value_type{};
+    m_removed[index] = true;
+    m_free.push_back(IndexType(index));
+  }
+
+  bool live(size_t index) const {
+    return index < m_removed.size() && !m_removed[index];
+  }
+  size_t free_count() const { return m_free.size(); }
+
+  // One flag per slot, true once erased. Indexable by compact().
+  const std::vector<bool>& removed() const { return m_removed; }
+
+  // Every slot live again, e.g. after compact()
+  void reset(size_t size) {
+    m_removed.assign(size, false);
+    m_free.clear();
+  }
+
+private:
+  template <class Objects>
+  void sync(const Objects& objects) {
+    size_t size = std::ranges::size(objects);
+    if (size < m_removed.size())
+      throw std::logic_error("Array shrank behind slot_allocator");
+    m_removed.resize(size, false);
+  }
+
+  std::vector<IndexType> m_free;
+  std::vector<bool>      m_removed;
+};
+
+// Drops every object of header.*TargetPtr with removed[i] set, keeping the
+// rest in order, and rewrites every reference listed in Refs to match. Each
+// Refs is an index_refs<>. A reference to a removed object, or a span
+// covering one, throws std::invalid_argument; references held by removed
+// objects themselves are ignored. As with relayout(), every reference is
+// checked in parallel before any is rewritten or any object moves, so a
+// throw leaves the header unchanged. Returns each old index's new index,
+// or removed_index, for references held outside the Header.
+template <auto TargetPtr, class... Refs, class Header>
+std::vector<size_t>
+compact(Header& header, const std::vector<bool>& removed,
+        size_t chunkSize   = default_parallel_chunk,
+        size_t threadCount = std::thread::hardware_concurrency()) {
+  auto&  objects = header.*TargetPtr;
+  size_t size    = std::ranges::size(objects);
+  if (removed.size() > size)
+    throw std::invalid_argument("removed has more entries than objects");
+  std::vector<size_t> newIndex(size);
+  size_t              live = 0;
+  for (size_t i = 0; i < size; ++i)
+    newIndex[i] = i < removed.size() && removed[i] ? removed_index : live++;
+  if (live == size)
+    return newIndex;
+  relayout_detail::remap_refs<TargetPtr, Refs...>(header, newIndex, chunkSize,
+                                                  threadCount);
+  // Objects only move down, so one forward pass is enough
+  auto begin = std::ranges::begin(objects);
+  for (size_t i = 0; i < size; ++i)
+    if (newIndex[i] != removed_index && newIndex[i] != i)
+      begin[ptrdiff_t(newIndex[i])] = std::move(begin[ptrdiff_t(i)]);
+  objects.erase(begin + ptrdiff_t(live), std::ranges::end(objects));
+  return newIndex;
+}
+
+// compact() with the slots erased from a slot_allocator, which is then
+// reset to the compacted size
+template <auto TargetPtr, class... Refs, class Header, class IndexType>
+std::vector<size_t>
+compact(Header& header, slot_allocator<TargetPtr, IndexType>& slots,
+        size_t chunkSize   = default_parallel_chunk,
+        size_t threadCount = std::thread::hardware_concurrency()) {
+  auto newIndex = compact<TargetPtr, Refs...>(header, slots.removed(),
+                                              chunkSize, threadCount);
+  slots.reset(std::ranges::size(header.*TargetPtr));
+  return newIndex;
+}
+
+} // namespace nodecode
@@ -0,0 +1,219 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <new>
+#include <nodecode/index_ptr.hpp>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+namespace nodecode {
+
+// Append-only array that index_ptr can target while other threads append.
+// Storage is a list of segments, each twice the size of the previous, so
+// objects never move and readers need no locks. Writers claim a slot with
+// an atomic increment. Segments are allocated on demand; racing writers
+// settle with a compare-and-swap. Elements become visible to size() and
+// iteration in index order once constructed.
+template <class T, unsigned FirstSegmentBits = 10>
+class concurrent_array {
+public:
+  using value_type = T;
+  static_assert(FirstSegmentBits < 32);
+  static constexpr size_t first_segment_size = size_t(1) << FirstSegmentBits;
+  static constexpr size_t max_segments       = 64 - FirstSegmentBits;
+
+  template <bool Const>
+  class basic_iterator {
+  public:
+    using array_type = std::conditional_t<Const, const concurrent_array,
+                                          concurrent_array>;
+    using iterator_concept = std::random_access_iterator_tag;
+    using value_type       = T;
+    using difference_type  = std::ptrdiff_t;
+    using reference = std::conditional_t<Const, const T&, T&>;
+    using pointer   = std::conditional_t<Const, const T*, T*>;
+    basic_iterator() = default;
+    basic_iterator(array_type* array, size_t index)
+        : m_array(array), m_index(index) {}
+    operator basic_iterator<true>() const
+      requires(!Const)
+    {
+      return {m_array, m_index};
+    }
+    reference operator*() const { return m_array->at_unchecked(m_index); }
+    pointer   operator->() const { return &**this; }
+    reference operator[](difference_type n) const { return *(*this + n); }
+    basic_iterator& operator++() {
+      ++m_index;
+      return *this;
+    }
+    basic_iterator& operator--() {
+      --m_index;
+      return *this;
+    }
+    basic_iterator operator++(int) { return {m_array, m_index++}; }
+    basic_iterator operator--(int) { return {m_array, m_index--}; }
+    basic_iterator& operator+=(difference_type n) {
+      m_index = size_t(difference_type(m_index) + n);
+      return *this;
+    }
+    basic_iterator& operator-=(difference_type n) { return *this += -n; }
+    friend basic_iterator operator+(basic_iterator it, difference_type n) {
+      return it += n;
+    }
+    friend basic_iterator operator+(difference_type n, basic_iterator it) {
+      return it += n;
+    }
+    friend basic_iterator operator-(basic_iterator it, difference_type n) {
+      return it -= n;
+    }
+    friend difference_type operator-(const basic_iterator& a,
+                                     const basic_iterator& b) {
+      return difference_type(a.m_index) - difference_type(b.m_index);
+    }
+    bool operator==(const basic_iterator& other) const {
+      return m_index == other.m_index;
+    }
+    auto operator<=>(const basic_iterator& other) const {
+      return m_index <=> other.m_index;
+    }
+
+  private:
+    array_type* m_array = nullptr;
+    size_t      m_index = 0;
+  };
+  using iterator       = basic_iterator<false>;
+  using const_iterator = basic_iterator<true>;
+
+  concurrent_array() = default;
+  concurrent_array(const concurrent_array& other) = delete;
+  concurrent_array& operator=(const concurrent_array& other) = delete;
+  ~concurrent_array() {
+    size_t size = m_size.load(std::memory_order_acquire);
+    for (size_t i = 0; i < size; ++i)
+      std::destroy_at(&at_unchecked(i));
+    for (size_t s = 0; s < max_segments; ++s)
+      if (T* segment = m_segments[s].load(std::memory_order_acquire))
+        ::operator delete(segment, std::align_val_t(alignof(T)));
+  }
+
+  // Constructs an object at the next free index and returns the index. Safe
+  // to call from any number of threads. The object is visible to size() once
+  // every earlier index has also been constructed. The constructor must not
+  // throw, as a reserved slot that is never published would block all later
+  // writers.
+  template <class... Args>
+    requires std::is_nothrow_constructible_v<T, Args...>
+  size_t emplace_back(Args&&... args) {
+    size_t index = m_reserved.fetch_add(1, std::memory_order_relaxed);
+    construct(index, std::forward<Args>(args)...);
+    return index;
+  }
+
+  // emplace_back() that throws std::out_of_range, before claiming a slot or
+  // constructing anything, if the index would exceed maxIndex, e.g. the
+  // largest value of an IndexType. Claims with a compare-and-swap loop
+  // rather than one increment.
+  template <class... Args>
+    requires std::is_nothrow_constructible_v<T, Args...>
+  size_t emplace_back_checked(size_t maxIndex, Args&&... args) {
+    size_t index = m_reserved.load(std::memory_order_relaxed);
+    do {
+      if (index > maxIndex)
+        throw std::out_of_range("concurrent_array index exceeds IndexType");
+    } while (!m_reserved.compare_exchange_weak(index, index + 1,
+                                               std::memory_order_relaxed));
+    construct(index, std::forward<Args>(args)...);
+    return index;
+  }
+  size_t push_back(const T& value) { return emplace_back(value); }
+  size_t push_back(T&& value) { return emplace_back(std::move(value)); }
+
+  // Number of constructed objects. Only these may be read.
+  size_t size() const { return m_size.load(std::memory_order_acquire); }
+  bool   empty() const { return size() == 0; }
+
+  T&       operator[](size_t index) { return at_unchecked(index); }
+  const T& operator[](size_t index) const { return at_unchecked(index); }
+
+  // Iterators reach every index, not only size(), so that index_ptr
+  // arithmetic from begin() works on objects published after the iterator
+  // was made
+  iterator       begin() { return {this, 0}; }
+  iterator       end() { return {this, size()}; }
+  const_iterator begin() const { return {this, 0}; }
+  const_iterator end() const { return {this, size()}; }
+
+private:
+  struct location {
+    size_t segment;
+    size_t offset;
+  };
+  static location locate(size_t index) {
+    size_t   shifted = index + first_segment_size;
+    unsigned top     = unsigned(std::bit_width(shifted)) - 1;
+    return {top - FirstSegmentBits, shifted - (size_t(1) << top)};
+  }
+  T& at_unchecked(size_t index) const {
+    auto [segment, offset] = locate(index);
+    return m_segments[segment].load(std::memory_order_acquire)[offset];
+  }
+  // Constructs the object in a claimed slot and publishes it
+  template <class... Args>
+  void construct(size_t index, Args&&... args) {
+    auto [segment, offset] = locate(index);
+    T* base = m_segments[segment].load(std::memory_order_acquire);
+    if (!base)
+      base = allocate(segment);
+    std::construct_at(base + offset, std::forward<Args>(args)...);
+    // Publish in index order so size() never covers an unconstructed slot
+    size_t expected = index;
+    while (!m_size.compare_exchange_weak(expected, index + 1,
+                                         std::memory_order_release,
+                                         std::memory_order_relaxed)) {
+      expected = index;
+      std::this_thread::yield();
+    }
+  }
+  T* allocate(size_t segment) {
+    size_t count = first_segment_size << segment;
+    T*     fresh = static_cast<T*>(
+        ::operator new(count * sizeof(T), std::align_val_t(alignof(T))));
+    T* expected = nullptr;
+    if (m_segments[segment].compare_exchange_strong(
+            expected, fresh, std::memory_order_acq_rel,
+            std::memory_order_acquire))
+      return fresh;
+    ::operator delete(fresh, std::align_val_t(alignof(T)));
+    return expected;
+  }
+
+  std::array<std::atomic<T*>, max_segments> m_segments{};
+  std::atomic<size_t>                       m_reserved = 0;
+  std::atomic<size_t>                       m_size     = 0;
+};
+
+// Appends to header.*ObjectsPtr, a concurrent_array, and returns an
+// index_ptr to the new object. Throws std::out_of_range, leaving the array
+// unchanged, once IndexType cannot address the next index.
+template <auto ObjectsPtr, class IndexType = uint32_t, class... Args>
+index_ptr<ObjectsPtr, IndexType>
+append(member_class_t<decltype(ObjectsPtr)>& header, Args&&... args) {
+  size_t index = (header.*ObjectsPtr)
+                     .emplace_back_checked(
+                         size_t(std::numeric_limits<IndexType>::max()),
+                         std::forward<Args>(args)...);
+  return static_cast<IndexType>(index);
+}
+
+} // namespace nodecode
@@ -0,0 +1,146 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#pragma once
+
+#include <algorithm>
+#include <compare>
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace nodecode {
+
+// Copy on write array for versioned_header. Objects are stored in fixed size
+// chunks shared between copies, so copying a cow_array only copies the chunk
+// table. mutate() gives write access to one object, first cloning its chunk
+// if another copy still shares it. Reads are always const, so an older copy
+// can be read from other threads while a newer one is modified.
+template <class T, unsigned ChunkBits = 12>
+class cow_array {
+public:
+  using value_type = T;
+  static constexpr size_t chunk_size = size_t(1) << ChunkBits;
+
+  class const_iterator {
+  public:
+    using iterator_concept = std::random_access_iterator_tag;
+    using value_type       = T;
+    using difference_type  = std::ptrdiff_t;
+    using reference        = const T&;
+    using pointer          = const T*;
+    const_iterator()       = default;
+    const_iterator(const cow_array* array, size_t index)
+        : m_array(array), m_index(index) {}
+    reference operator*() const { return (*m_array)[m_index]; }
+    pointer   operator->() const { return &**this; }
+    reference operator[](difference_type n) const { return *(*this + n); }
+    const_iterator& operator++() {
+      ++m_index;
+      return *this;
+    }
+    const_iterator& operator--() {
+      --m_index;
+      return *this;
+    }
+    const_iterator operator++(int) { return {m_array, m_index++}; }
+    const_iterator operator--(int) { return {m_array, m_index--}; }
+    const_iterator& operator+=(difference_type n) {
+      m_index = size_t(difference_type(m_index) + n);
+      return *this;
+    }
+    const_iterator& operator-=(difference_type n) { return *this += -n; }
+    friend const_iterator operator+(const_iterator it, difference_type n) {
+      return it += n;
+    }
+    friend const_iterator operator+(difference_type n, const_iterator it) {
+      return it += n;
+    }
+    friend const_iterator operator-(const_iterator it, difference_type n) {
+      return it -= n;
+    }
+    friend difference_type operator-(const const_iterator& a,
+                                     const const_iterator& b) {
+      return difference_type(a.m_index) - difference_type(b.m_index);
+    }
+    bool operator==(const const_iterator& other) const {
+      return m_index == other.m_index;
+    }
+    auto operator<=>(const const_iterator& other) const {
+      return m_index <=> other.m_index;
+    }
+
+  private:
+    const cow_array* m_array = nullptr;
+    size_t           m_index = 0;
+  };
+  using iterator = const_iterator;
+
+  cow_array() = default;
+  explicit cow_array(size_t size, const T& value = T()) {
+    for (size_t i = 0; i < size; ++i)
+      push_back(value);
+  }
+  template <std::input_iterator Iterator>
+  cow_array(Iterator first, Iterator last) {
+    for (; first != last; ++first)
+      push_back(*first);
+  }
+
+  size_t   size() const { return m_size; }
+  bool     empty() const { return m_size == 0; }
+  const T& operator[](size_t index) const {
+    return m_chunks[index >> ChunkBits][index & (chunk_size - 1)];
+  }
+  const_iterator begin() const { return {this, 0}; }
+  const_iterator end() const { return {this, m_size}; }
+
+  // Write access to one object. Clones its chunk first if shared.
+  T& mutate(size_t index) {
+    if (index >= m_size)
+      throw std::out_of_range("cow_array index out of range");
+    return own(index >> ChunkBits)[index & (chunk_size - 1)];
+  }
+  void set(size_t index, T value) { mutate(index) = std::move(value); }
+
+  template <class... Args>
+  T& emplace_back(Args&&... args) {
+    size_t chunk = m_size >> ChunkBits;
+    if (chunk == m_chunks.size())
+      m_chunks.push_back(std::make_shared<T[]>(chunk_size));
+    T& result = own(chunk)[m_size & (chunk_size - 1)];
+    result    = T(std::forward<Args>(args)...);
+    ++m_size;
+    return result;
+  }
+  void push_back(const T& value) { emplace_back(value); }
+  void push_back(T&& value) { emplace_back(std::move(value)); }
+
+  // Number of chunks this copy shares with any other. Unshared chunks are
+  // the ones a new version copied.
+  size_t shared_chunks() const {
+    size_t result = 0;
+    for (auto& chunk : m_chunks)
+      result += chunk.use_count() > 1 ? 1 : 0;
+    return result;
+  }
+
+private:
+  T* own(size_t chunk) {
+    auto& pointer = m_chunks[chunk];
+    if (pointer.use_count() > 1) {
+      auto   copy  = std::make_shared<T[]>(chunk_size);
+      size_t count = std::min(chunk_size, m_size - (chunk << ChunkBits));
+      std::copy(pointer.get(), pointer.get() + count, copy.get());
+      pointer = std::move(copy);
+    }
+    return pointer.get();
+  }
+
+  std::vector<std::shared_ptr<T[]>> m_chunks;
+  size_t                            m_size = 0;
+};
+
+} // namespace nodecode
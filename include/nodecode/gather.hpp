@@ -0,0 +1,199 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#pragma once
+
+#include <cinttypes>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <nodecode/index_ptr.hpp>
+#include <ranges>
+#include <stdexcept>
+#include <type_traits>
+
+#if defined(__AVX2__) || defined(__AVX512F__)
+  #include <immintrin.h>
+  #define NODECODE_SIMD_GATHER 1
+#else
+  #define NODECODE_SIMD_GATHER 0
+#endif
+
+namespace nodecode {
+
+// Batch dereference of a contiguous range of index_ptr. With AVX2 or
+// AVX-512 enabled at compile time, 4 and 8 byte values addressed by 32 bit
+// indices are loaded with hardware gathers. Everything else falls back to
+// a scalar loop.
+
+template <class T, class IndexType>
+inline constexpr bool simd_gather_v =
+#if NODECODE_SIMD_GATHER
+    std::is_trivially_copyable_v<T> && (sizeof(T) == 4 || sizeof(T) == 8) &&
+    sizeof(IndexType) == 4;
+#else
+    false;
+#endif
+
+template <class T, class IndexType, class Init, class BinaryOp>
+inline constexpr bool simd_gather_reduce_v =
+    simd_gather_v<T, IndexType> && std::is_integral_v<T> &&
+    std::is_same_v<Init, T> &&
+    (std::is_same_v<BinaryOp, std::plus<>> ||
+     std::is_same_v<BinaryOp, std::plus<T>>);
+
+template <class Ptrs>
+using gather_pointer_t = std::remove_cvref_t<std::ranges::range_value_t<Ptrs>>;
+
+namespace gather_detail {
+
+#if defined(__AVX512F__)
+template <class T>
+inline auto load(const T* base, const void* indices) {
+  // Masked forms with a zero source avoid GCC's maybe-uninitialized false
+  // positive on the unmasked intrinsics
+  if constexpr (sizeof(T) == 4)
+    return _mm512_mask_i32gather_epi32(_mm512_setzero_si512(), 0xffff,
+                                       _mm512_loadu_si512(indices), base, 4);
+  else
+    return _mm512_mask_i32gather_epi64(
+        _mm512_setzero_si512(), 0xff,
+        _mm256_loadu_si256(static_cast<const __m256i*>(indices)), base, 8);
+}
+template <class T>
+inline constexpr size_t lanes = 64 / sizeof(T);
+template <class T, class V>
+inline V add(V a, V b) {
+  if constexpr (sizeof(T) == 4)
+    return _mm512_add_epi32(a, b);
+  else
+    return _mm512_add_epi64(a, b);
+}
+inline auto zero() { return _mm512_setzero_si512(); }
+template <class V>
+inline void store(void* out, V v) {
+  _mm512_storeu_si512(out, v);
+}
+#elif defined(__AVX2__)
+template <class T>
+inline auto load(const T* base, const void* indices) {
+  auto ints = reinterpret_cast<const int*>(base);
+  if constexpr (sizeof(T) == 4)
+    return _mm256_i32gather_epi32(
+        ints, _mm256_loadu_si256(static_cast<const __m256i*>(indices)), 4);
+  else
+    return _mm256_i32gather_epi64(
+        reinterpret_cast<const long long*>(base),
+        _mm_loadu_si128(static_cast<const __m128i*>(indices)), 8);
+}
+template <class T>
+inline constexpr size_t lanes = 32 / sizeof(T);
+template <class T, class V>
+inline V add(V a, V b) {
+  if constexpr (sizeof(T) == 4)
+    return _mm256_add_epi32(a, b);
+  else
+    return _mm256_add_epi64(a, b);
+}
+inline auto zero() { return _mm256_setzero_si256(); }
+template <class V>
+inline void store(void* out, V v) {
+  _mm256_storeu_si256(static_cast<__m256i*>(out), v);
+}
+#endif
+
+// Gather instructions take signed 32 bit indices
+template <class Range>
+bool simd_indexable(const Range& range) {
+  return std::ranges::size(range) <=
+         size_t(std::numeric_limits<int32_t>::max());
+}
+
+// Only instantiated when simd_gather_v holds. Both return the number of
+// ptrs consumed, leaving the remainder for the scalar loop.
+template <class T, class Ptr>
+size_t gather_lanes(const T* base, const Ptr* src, T* dst, size_t size);
+template <class T, class Ptr, class Init, class BinaryOp>
+size_t reduce_lanes(const T* base, const Ptr* src, size_t size, Init& init,
+                    BinaryOp& op);
+
+#if NODECODE_SIMD_GATHER
+template <class T, class Ptr>
+size_t gather_lanes(const T* base, const Ptr* src, T* dst, size_t size) {
+  size_t i = 0;
+  for (; i + lanes<T> <= size; i += lanes<T>)
+    store(dst + i, load(base, src + i));
+  return i;
+}
+
+template <class T, class Ptr, class Init, class BinaryOp>
+size_t reduce_lanes(const T* base, const Ptr* src, size_t size, Init& init,
+                    BinaryOp& op) {
+  if (size < lanes<T>)
+    return 0;
+  size_t i   = 0;
+  auto   sum = zero();
+  for (; i + lanes<T> <= size; i += lanes<T>)
+    sum = add<T>(sum, load(base, src + i));
+  T partial[lanes<T>];
+  store(partial, sum);
+  for (auto value : partial)
+    init = op(init, value);
+  return i;
+}
+#endif
+
+} // namespace gather_detail
+
+// Writes *ptr for each ptr in ptrs to out, which must have room for
+// ptrs.size() values
+template <std::ranges::contiguous_range Ptrs, class Out>
+  requires std::ranges::contiguous_range<Out>
+void gather(const Ptrs& ptrs,
+            typename gather_pointer_t<Ptrs>::header_type& header, Out&& out) {
+  using pointer_type = gather_pointer_t<Ptrs>;
+  using value_type   = std::remove_const_t<typename pointer_type::value_type>;
+  using index_type   = typename pointer_type::index_type;
+  static_assert(sizeof(pointer_type) == sizeof(index_type));
+  size_t size = std::ranges::size(ptrs);
+  if (std::ranges::size(out) < size)
+    throw std::out_of_range("gather output too small");
+  auto&       objects = header.*pointer_type::objects_ptr;
+  auto*       base    = std::ranges::data(objects);
+  auto*       dst     = std::ranges::data(out);
+  const auto* src     = std::ranges::data(ptrs);
+  size_t      i       = 0;
+  if constexpr (simd_gather_v<value_type, index_type> &&
+                std::is_same_v<value_type, std::ranges::range_value_t<Out>>) {
+    if (gather_detail::simd_indexable(objects))
+      i = gather_detail::gather_lanes<value_type>(base, src, dst, size);
+  }
+  for (; i < size; ++i)
+    dst[i] = base[static_cast<const index_type&>(src[i])];
+}
+
+// std::accumulate(ptrs, init, op) over *ptr. Sums of integers with
+// std::plus use the SIMD gather path.
+template <std::ranges::contiguous_range Ptrs, class T,
+          class BinaryOp = std::plus<>>
+T gather_reduce(const Ptrs&                                   ptrs,
+                typename gather_pointer_t<Ptrs>::header_type& header, T init,
+                BinaryOp op = {}) {
+  using pointer_type = gather_pointer_t<Ptrs>;
+  using value_type   = std::remove_const_t<typename pointer_type::value_type>;
+  using index_type   = typename pointer_type::index_type;
+  static_assert(sizeof(pointer_type) == sizeof(index_type));
+  size_t      size    = std::ranges::size(ptrs);
+  auto&       objects = header.*pointer_type::objects_ptr;
+  auto*       base    = std::ranges::data(objects);
+  const auto* src     = std::ranges::data(ptrs);
+  size_t      i       = 0;
+  if constexpr (simd_gather_reduce_v<value_type, index_type, T, BinaryOp>) {
+    if (gather_detail::simd_indexable(objects))
+      i = gather_detail::reduce_lanes<value_type>(base, src, size, init, op);
+  }
+  for (; i < size; ++i)
+    init = op(init, base[static_cast<const index_type&>(src[i])]);
+  return init;
+}
+
+} // namespace nodecode
@@ -0,0 +1,218 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <new>
+#include <nodecode/index_ptr.hpp>
+#include <nodecode/mapped_file.hpp>
+#include <ranges>
+#include <span>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace nodecode {
+
+template <auto... ObjectsPtrs>
+class header_builder;
+
+// A single cache line aligned allocation holding every array of a Header,
+// laid out exactly like a file from write_file(). header() has std::span
+// members pointing into the arena.
+template <auto... ObjectsPtrs>
+class header_arena {
+public:
+  using header_type = objects_header_t<ObjectsPtrs...>;
+
+  header_arena(const header_arena& other) = delete;
+  header_arena(header_arena&& other) noexcept
+      : m_bytes(std::exchange(other.m_bytes, nullptr)),
+        m_size(std::exchange(other.m_size, 0)), m_header(other.m_header) {}
+  header_arena& operator=(const header_arena& other) = delete;
+  header_arena& operator=(header_arena&& other) noexcept {
+    std::swap(m_bytes, other.m_bytes);
+    std::swap(m_size, other.m_size);
+    std::swap(m_header, other.m_header);
+    return *this;
+  }
+  ~header_arena() {
+    if (!m_bytes)
+      return;
+    (std::destroy(std::ranges::begin(m_header.*ObjectsPtrs),
+                  std::ranges::end(m_header.*ObjectsPtrs)),
+     ...);
+    ::operator delete(m_bytes, std::align_val_t(file_section_alignment));
+  }
+
+  header_type&       operator*() { return m_header; }
+  const header_type& operator*() const { return m_header; }
+  header_type*       operator->() { return &m_header; }
+  const header_type* operator->() const { return &m_header; }
+  header_type&       get() { return m_header; }
+  const header_type& get() const { return m_header; }
+
+  // The arena in the mapped_file format. Only meaningful to copy elsewhere
+  // when all value_types are trivially copyable.
+  std::span<const std::byte> bytes() const { return {m_bytes, m_size}; }
+
+  void write(const std::filesystem::path& path) const {
+    static_assert(
+        (std::is_trivially_copyable_v<objects_value_t<ObjectsPtrs>> && ...),
+        "file sections must be trivially copyable");
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(m_bytes),
+               std::streamsize(m_size));
+    if (!file)
+      throw std::runtime_error("Failed to write " + path.string());
+  }
+
+private:
+  template <auto...>
+  friend class header_builder;
+
+  template <class Vectors>
+  explicit header_arena(Vectors& vectors) {
+    auto layout = file_layout::make<ObjectsPtrs...>(std::apply(
+        [](auto&... v) {
+          return std::array<uint64_t, sizeof...(ObjectsPtrs)>{
+              uint64_t(v.size())...};
+        },
+        vectors));
+    m_size  = layout.header.file_size;
+    m_bytes = static_cast<std::byte*>(::operator new(
+        m_size, std::align_val_t(file_section_alignment)));
+    layout.write_directory(m_bytes);
+    size_t i = 0;
+    std::apply(
+        [&](auto&... v) {
+          (std::uninitialized_move(v.begin(), v.end(),
+                                   reinterpret_cast<typename std::remove_cvref_t<
+                                       decltype(v)>::value_type*>(
+                                       m_bytes + layout.sections[i++].offset)),
+           ...);
+        },
+        vectors);
+    m_header = load_header<ObjectsPtrs...>({m_bytes, m_size});
+  }
+
+  std::byte*  m_bytes = nullptr;
+  size_t      m_size  = 0;
+  header_type m_header{};
+};
+
+// Collects the objects of each ObjectsPtr array in separate vectors, then
+// packs them all into one header_arena. Pointers and iterators into the
+// collected objects can be converted to indices in bulk.
+template <auto... ObjectsPtrs>
+class header_builder {
+public:
+  using header_type = objects_header_t<ObjectsPtrs...>;
+
+  template <auto ObjectsPtr>
+  using value_type = objects_value_t<ObjectsPtr>;
+
+  template <auto ObjectsPtr>
+  std::vector<value_type<ObjectsPtr>>& objects() {
+    return std::get<objects_index<ObjectsPtr, ObjectsPtrs...>()>(m_vectors);
+  }
+  template <auto ObjectsPtr>
+  const std::vector<value_type<ObjectsPtr>>& objects() const {
+    return std::get<objects_index<ObjectsPtr, ObjectsPtrs...>()>(m_vectors);
+  }
+
+  // Throws std::out_of_range, leaving the array unchanged, if the new
+  // object's index does not fit IndexType
+  template <auto ObjectsPtr, class IndexType = uint32_t, class... Args>
+  index_ptr<ObjectsPtr, IndexType> emplace_back(Args&&... args) {
+    auto&  vec   = objects<ObjectsPtr>();
+    size_t index = vec.size();
+    if (!fits<IndexType>(index, 1))
+      throw std::out_of_range("Array is full for IndexType");
+    vec.emplace_back(std::forward<Args>(args)...);
+    return static_cast<IndexType>(index);
+  }
+
+  // Throws std::out_of_range, after removing the appended objects, if an
+  // index into the span or its size does not fit IndexType
+  template <auto ObjectsPtr, class IndexType = uint32_t, class Range>
+  index_span<ObjectsPtr, IndexType> append_range(Range&& range) {
+    auto&  vec   = objects<ObjectsPtr>();
+    size_t index = vec.size();
+    vec.insert(vec.end(), std::ranges::begin(range), std::ranges::end(range));
+    size_t count = vec.size() - index;
+    if (!fits<IndexType>(index, count)) {
+      vec.erase(vec.begin() + ptrdiff_t(index), vec.end());
+      throw std::out_of_range("Array is full for IndexType");
+    }
+    return {static_cast<IndexType>(index), static_cast<IndexType>(count)};
+  }
+
+  // Converts pointers or contiguous iterators to collected objects into
+  // index_ptrs, writing to out. Throws std::out_of_range if an index does
+  // not fit IndexType.
+  template <auto ObjectsPtr, class IndexType = uint32_t, class Range,
+            class OutputIt>
+  OutputIt to_index_ptrs(Range&& pointers, OutputIt out) const {
+    auto& vec  = objects<ObjectsPtr>();
+    auto* base = vec.data();
+    auto  size = vec.size();
+    for (auto& pointer : pointers) {
+      auto index = std::to_address(pointer) - base;
+      if (index < 0 || size_t(index) >= size)
+        throw std::out_of_range("Pointer is not in the target array");
+      if (!fits<IndexType>(size_t(index), 1))
+        throw std::out_of_range("Index does not fit IndexType");
+      *out++ = index_ptr<ObjectsPtr, IndexType>(static_cast<IndexType>(index));
+    }
+    return out;
+  }
+
+  // Converts contiguous subranges of collected objects into index_spans,
+  // writing to out. Throws std::out_of_range if an index into a span or its
+  // size does not fit IndexType.
+  template <auto ObjectsPtr, class IndexType = uint32_t, class Range,
+            class OutputIt>
+  OutputIt to_index_spans(Range&& ranges, OutputIt out) const {
+    auto& vec  = objects<ObjectsPtr>();
+    auto* base = vec.data();
+    auto  size = vec.size();
+    for (auto& range : ranges) {
+      auto index = std::ranges::data(range) - base;
+      auto count = std::ranges::size(range);
+      if (index < 0 || size_t(index) + count > size)
+        throw std::out_of_range("Range is not in the target array");
+      if (!fits<IndexType>(size_t(index), count))
+        throw std::out_of_range("Span does not fit IndexType");
+      *out++ = index_span<ObjectsPtr, IndexType>(static_cast<IndexType>(index),
+                                                 static_cast<IndexType>(count));
+    }
+    return out;
+  }
+
+  // Moves all collected objects into a single allocation. The builder is
+  // left empty.
+  header_arena<ObjectsPtrs...> build() {
+    header_arena<ObjectsPtrs...> result(m_vectors);
+    m_vectors = {};
+    return result;
+  }
+
+private:
+  // Whether IndexType holds count and every index in [index, index + count)
+  template <class IndexType>
+  static bool fits(size_t index, size_t count) {
+    constexpr size_t max = std::numeric_limits<IndexType>::max();
+    return index <= max && count <= max && (!count || count - 1 <= max - index);
+  }
+
+  std::tuple<std::vector<value_type<ObjectsPtrs>>...> m_vectors;
+};
+
+} // namespace nodecode
@@ -2,14 +2,23 @@
 
 #pragma once
 
+#include <algorithm>
 #include <cinttypes>
 #include <iterator>
 #include <ranges>
 #include <span>
 #include <stdexcept>
+#include <tuple>
 #include <type_traits>
 #include <vector>
 
+#ifndef NODECODE_INSTRUMENT
+  #define NODECODE_INSTRUMENT 0
+#endif
+#if NODECODE_INSTRUMENT
+  #include <nodecode/instrument.hpp>
+#endif
+
 namespace nodecode {
 
 template <class Header>
@@ -58,6 +67,34 @@ template <class T> using member_type_t = member_traits<T>::value_type;
 
 template <class T> using member_class_t = member_traits<T>::class_type;
 
+// The Header class shared by a list of ObjectsPtr members
+template <auto ObjectsPtr, auto... ObjectsPtrs>
+struct objects_header {
+  using type = member_class_t<decltype(ObjectsPtr)>;
+  static_assert(
+      (std::is_same_v<type, member_class_t<decltype(ObjectsPtrs)>> && ...),
+      "ObjectsPtrs must all be members of the same Header");
+};
+
+template <auto... ObjectsPtrs>
+using objects_header_t = typename objects_header<ObjectsPtrs...>::type;
+
+// Position of ObjectsPtr in a list of ObjectsPtrs
+template <auto ObjectsPtr, auto... ObjectsPtrs>
+constexpr size_t objects_index() {
+  size_t i = 0, result = sizeof...(ObjectsPtrs);
+  (
+      [&] {
+        if constexpr (std::is_same_v<decltype(ObjectsPtr),
+                                     decltype(ObjectsPtrs)>)
+          if (ObjectsPtr == ObjectsPtrs)
+            result = i;
+        ++i;
+      }(),
+      ...);
+  return result;
+}
+
 template <auto ObjectsPtr, class IndexType = uint32_t, bool ConstHeader = false>
 #if 0
   // cannot validate range concept as end() will likely require pointer
@@ -70,7 +107,8 @@ public:
   using mutable_header_type = member_class_t<decltype(ObjectsPtr)>;
   using header_type = std::conditional_t<ConstHeader, const mutable_header_type,
                                          mutable_header_type>;
-  using iterator = std::ranges::iterator_t<range_type>;
+  using iterator = std::ranges::iterator_t<
+      std::conditional_t<ConstHeader, const range_type, range_type>>;
   #if 0
   // cannot validate range concept as end() will likely require pointer
   // arithmetic and thus a complete type
@@ -80,24 +118,33 @@ public:
   using value_type = std::remove_reference_t<std::iter_reference_t<iterator>>;
   #endif
   using index_type = IndexType;
-  index_ptr()      = default;
-  index_ptr(const index_type& index) : m_index(index) {}
-  iterator bind(header_type& header) const {
+  static constexpr auto objects_ptr = ObjectsPtr;
+  constexpr index_ptr() = default;
+  constexpr index_ptr(const index_type& index) : m_index(index) {}
+  constexpr iterator bind(header_type& header) const {
+#if NODECODE_INSTRUMENT
+    return instrument::deref<ObjectsPtr>(
+        std::ranges::begin(header.*ObjectsPtr), m_index);
+#else
     return std::ranges::begin(header.*ObjectsPtr) + m_index;
+#endif
   }
   iterator get() const { return bind(*bound_header<header_type>::get()); }
   value_type&   operator[](index_type pos) const { return get()[pos]; }
   value_type&   operator*() const { return *get(); }
   auto*         operator->() const { return get().operator->(); }
-  operator index_type&() { return m_index; }
-  operator const index_type&() const { return m_index; }
+  constexpr operator index_type&() { return m_index; }
+  constexpr operator const index_type&() const { return m_index; }
 
 private:
   index_type m_index = 0;
 };
 
-// std::span equivalent but implemented with an index_ptr
-template <auto ObjectsPtr, class IndexType = uint32_t, bool ConstHeader = false>
+// std::span equivalent but implemented with an index_ptr. SizeType may be
+// narrower than IndexType, e.g. uint16_t indices with uint8_t sizes make a
+// 4 byte span. See packed_index_span for packing both into one word.
+template <auto ObjectsPtr, class IndexType = uint32_t, bool ConstHeader = false,
+          class SizeType = IndexType>
 class index_span {
 public:
   using pointer_type  = index_ptr<ObjectsPtr, IndexType, ConstHeader>;
@@ -107,11 +154,13 @@ public:
   using begin_result  = decltype(std::begin(std::declval<header_type>().*ObjectsPtr));
   using value_type    = typename pointer_type::value_type;
   using index_type    = IndexType;
-  index_span()        = default;
-  index_span(const index_type& index, const index_type& size)
+  using size_type     = SizeType;
+  static constexpr auto objects_ptr = ObjectsPtr;
+  constexpr index_span() = default;
+  constexpr index_span(const index_type& index, const size_type& size)
       : m_index(index), m_size(size) {}
   static index_span
-  from_pointer(value_type* pointer, index_type size,
+  from_pointer(value_type* pointer, size_type size,
                header_type& header = *bound_header<header_type>::get()) {
     auto base = std::ranges::data(header.*ObjectsPtr);
     return {static_cast<index_type>(pointer - base), size};
@@ -120,10 +169,10 @@ public:
   from_pointer(value_type* begin, value_type* end,
                header_type& header = *bound_header<header_type>::get()) {
     return from_pointer(
-        begin, static_cast<index_type>(std::distance(begin, end)), header);
+        begin, static_cast<size_type>(std::distance(begin, end)), header);
   }
   static index_span
-  from_iterator(begin_result begin, index_type size,
+  from_iterator(begin_result begin, size_type size,
                 header_type& header = *bound_header<header_type>::get()) {
     auto base = std::ranges::begin(header.*ObjectsPtr);
     return {static_cast<index_type>(begin - base), size};
@@ -132,7 +181,7 @@ public:
   from_iterator(begin_result begin, begin_result end,
                 header_type& header = *bound_header<header_type>::get()) {
     return from_iterator(
-        begin, static_cast<index_type>(std::distance(begin, end)), header);
+        begin, static_cast<size_type>(std::distance(begin, end)), header);
   }
   template <class Range>
     requires std::ranges::contiguous_range<Range>
@@ -140,12 +189,12 @@ public:
   from_range(Range&&      range,
              header_type& header = *bound_header<header_type>::get()) {
     return from_pointer(std::ranges::data(range),
-                        static_cast<index_type>(std::ranges::size(range)),
+                        static_cast<size_type>(std::ranges::size(range)),
                         header);
   }
   value_type*       data() const { return &*m_index.get(); }
-  const index_type& index() const { return m_index; }
-  const index_type& size() const { return m_size; }
+  constexpr const index_type& index() const { return m_index; }
+  constexpr const size_type&  size() const { return m_size; }
   auto              begin() const { return m_index.get(); }
   auto              end() const { return m_index.get() + size(); }
   value_type&       operator[](index_type pos) const { return begin()[pos]; }
@@ -166,7 +215,133 @@ public:
 
 private:
   pointer_type m_index;
-  index_type   m_size = 0;
+  size_type    m_size = 0;
+};
+
+template <class T>
+struct is_index_ptr : std::false_type {};
+template <auto ObjectsPtr, class IndexType, bool ConstHeader>
+struct is_index_ptr<index_ptr<ObjectsPtr, IndexType, ConstHeader>>
+    : std::true_type {};
+template <class T>
+inline constexpr bool is_index_ptr_v = is_index_ptr<T>::value;
+
+template <class T>
+struct is_index_span : std::false_type {};
+template <auto ObjectsPtr, class IndexType, bool ConstHeader, class SizeType>
+struct is_index_span<index_span<ObjectsPtr, IndexType, ConstHeader, SizeType>>
+    : std::true_type {};
+template <class T>
+inline constexpr bool is_index_span_v = is_index_span<T>::value;
+
+// Names index_ptr or index_span objects in a Header for whole-header passes
+// such as relayout() and validate(): every element of header.*ArrayPtr, or
+// the MemberPtr of every element when given. A Header has no reflection, so
+// each place holding references has to be listed.
+template <auto ArrayPtr, auto... MemberPtr>
+struct index_refs {
+  static_assert(sizeof...(MemberPtr) <= 1, "at most one MemberPtr");
+};
+
+// Whether two member pointers, possibly of different types, are the same
+template <auto A, auto B>
+constexpr bool same_member() {
+  if constexpr (std::is_same_v<decltype(A), decltype(B)>)
+    return A == B;
+  else
+    return false;
+}
+
+// The reference index_refs<ArrayPtr, MemberPtr...> names in element, with
+// element's constness
+template <class Element>
+Element& ref_of(Element& element) {
+  return element;
+}
+template <auto MemberPtr, class Element>
+auto& ref_of(Element& element) {
+  return element.*MemberPtr;
+}
+
+// Caches the begin() iterator of each ObjectsPtr array of a Header, so
+// dereferencing through it is just base + index with no thread_local lookup
+// and no exception path. Like a pointer, it is invalidated if the arrays are
+// reallocated.
+template <auto... ObjectsPtrs>
+class bound_view {
+public:
+  using header_type = objects_header_t<ObjectsPtrs...>;
+  bound_view(header_type& header)
+      : m_begins(std::ranges::begin(header.*ObjectsPtrs)...) {}
+
+  template <auto ObjectsPtr>
+  auto begin() const {
+    constexpr size_t i = objects_index<ObjectsPtr, ObjectsPtrs...>();
+    static_assert(i < sizeof...(ObjectsPtrs), "ObjectsPtr not in bound_view");
+    return std::get<i>(m_begins);
+  }
+  template <auto ObjectsPtr, class IndexType, bool ConstHeader>
+  auto bind(const index_ptr<ObjectsPtr, IndexType, ConstHeader>& ptr) const {
+#if NODECODE_INSTRUMENT
+    return instrument::deref<ObjectsPtr>(begin<ObjectsPtr>(),
+                                         static_cast<const IndexType&>(ptr));
+#else
+    return begin<ObjectsPtr>() + static_cast<const IndexType&>(ptr);
+#endif
+  }
+  template <auto ObjectsPtr, class IndexType, bool ConstHeader>
+  auto& operator[](const index_ptr<ObjectsPtr, IndexType, ConstHeader>& ptr) const {
+    return *bind(ptr);
+  }
+  template <auto ObjectsPtr, class IndexType, bool ConstHeader,
+            class SizeType>
+  auto operator[](const index_span<ObjectsPtr, IndexType, ConstHeader,
+                                   SizeType>& span) const {
+    return std::span<typename index_span<ObjectsPtr, IndexType, ConstHeader,
+                                         SizeType>::value_type>(
+        begin<ObjectsPtr>() + span.index(), span.size());
+  }
+
+private:
+  std::tuple<std::ranges::iterator_t<member_type_t<decltype(ObjectsPtrs)>>...>
+      m_begins;
+};
+
+// Binds index_ptrs to a Header with static storage duration, named as a
+// template parameter, e.g. a constexpr lookup table. Dereferencing needs no
+// bound_header or cached pointer and is constexpr, so it compiles to a load
+// from the table's fixed address or is folded away entirely.
+template <const auto& Header>
+class static_view {
+public:
+  using header_type = std::remove_cvref_t<decltype(Header)>;
+  static constexpr const header_type& header() { return Header; }
+
+  template <auto ObjectsPtr, class IndexType, bool ConstHeader>
+  constexpr auto bind(const index_ptr<ObjectsPtr, IndexType, ConstHeader>& ptr) const {
+    static_assert(
+        std::is_same_v<header_type, member_class_t<decltype(ObjectsPtr)>>,
+        "index_ptr is not into this static_view's header");
+#if NODECODE_INSTRUMENT
+    return instrument::deref<ObjectsPtr>(std::ranges::begin(Header.*ObjectsPtr),
+                                         static_cast<const IndexType&>(ptr));
+#else
+    return std::ranges::begin(Header.*ObjectsPtr) +
+           static_cast<const IndexType&>(ptr);
+#endif
+  }
+  template <auto ObjectsPtr, class IndexType, bool ConstHeader>
+  constexpr auto& operator[](const index_ptr<ObjectsPtr, IndexType, ConstHeader>& ptr) const {
+    return *bind(ptr);
+  }
+  template <auto ObjectsPtr, class IndexType, bool ConstHeader,
+            class SizeType>
+  constexpr auto operator[](const index_span<ObjectsPtr, IndexType, ConstHeader,
+                                             SizeType>& span) const {
+    return std::span(
+        bind(index_ptr<ObjectsPtr, IndexType, ConstHeader>(span.index())),
+        span.size());
+  }
 };
 
 } // namespace nodecode
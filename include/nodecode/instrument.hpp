@@ -0,0 +1,272 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cinttypes>
+#include <cmath>
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+// Access instrumentation for index_ptr, compiled in with
+// -DNODECODE_INSTRUMENT=1. Every index_ptr or bound_view dereference then
+// records, per target array and per thread, the deref count, the stride
+// from the previous index into the same array and the cache line touched,
+// counted by a fixed size sketch. Like any macro that changes inline code,
+// it must be set the same way in every translation unit. When off, nothing
+// here is included and dereferencing is unchanged.
+
+namespace nodecode {
+
+namespace instrument {
+
+inline constexpr size_t cache_line_size = 64;
+
+// Strides are bucketed by bit width: bucket 0 holds repeated indices,
+// bucket k holds strides s with 2^(k-1) <= |s| < 2^k. Bucket 1 forward is
+// sequential access.
+inline constexpr size_t stride_buckets = 65;
+
+// Estimates the number of distinct cache lines inserted. A HyperLogLog
+// sketch: fixed size, no allocation or probing per insert, and merged
+// across threads without double counting. Linear counting takes over for
+// small counts, which are then exact unless two lines share a register;
+// large counts are within a few percent.
+class line_sketch {
+public:
+  static constexpr unsigned register_bits = 12;
+  static constexpr size_t   registers     = size_t(1) << register_bits;
+
+  void insert(uintptr_t line) {
+    uint64_t h = mix(line);
+    // Leading zeros of the remaining bits, capped by a guard bit
+    uint8_t rank = uint8_t(
+        std::countl_zero((h << register_bits) |
+                         (uint64_t(1) << (register_bits - 1))) +
+        1);
+    uint8_t& reg = m_registers[h >> (64 - register_bits)];
+    if (rank > reg)
+      reg = rank;
+  }
+  void merge(const line_sketch& other) {
+    for (size_t i = 0; i < registers; ++i)
+      m_registers[i] = std::max(m_registers[i], other.m_registers[i]);
+  }
+  uint64_t size() const {
+    double sum   = 0.0;
+    size_t zeros = 0;
+    for (uint8_t reg : m_registers) {
+      sum += std::ldexp(1.0, -int(reg));
+      zeros += reg == 0;
+    }
+    double m        = double(registers);
+    double estimate = 0.7213 / (1.0 + 1.079 / m) * m * m / sum;
+    if (estimate <= 2.5 * m && zeros)
+      estimate = m * std::log(m / double(zeros));
+    return uint64_t(std::llround(estimate));
+  }
+
+private:
+  // Lines are consecutive integers; spread them over all 64 bits
+  static constexpr uint64_t mix(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return h;
+  }
+
+  std::array<uint8_t, registers> m_registers{};
+};
+
+struct array_stats {
+  uint64_t                             derefs = 0;
+  std::array<uint64_t, stride_buckets> forward{};
+  std::array<uint64_t, stride_buckets> backward{};
+  line_sketch                          lines;
+  void merge(const array_stats& other) {
+    derefs += other.derefs;
+    for (size_t i = 0; i < stride_buckets; ++i) {
+      forward[i] += other.forward[i];
+      backward[i] += other.backward[i];
+    }
+    lines.merge(other.lines);
+  }
+};
+
+struct array_report {
+  std::string_view name;
+  array_stats      stats;
+};
+
+namespace detail {
+
+// Readable ObjectsPtr name from the compiler's function signature
+template <auto ObjectsPtr>
+std::string_view objects_name() {
+#if defined(__GNUC__)
+  std::string_view signature = __PRETTY_FUNCTION__;
+  size_t           begin     = signature.find("ObjectsPtr = ");
+  if (begin != std::string_view::npos) {
+    begin += std::string_view("ObjectsPtr = ").size();
+    size_t end = signature.find_first_of(";]", begin);
+    return signature.substr(begin, end - begin);
+  }
+  return signature;
+#else
+  return "array";
+#endif
+}
+
+struct array_state {
+  std::string_view name;
+  array_stats      stats;
+  uint64_t         last    = 0;
+  bool             hasLast = false;
+};
+
+struct thread_state;
+
+// Totals from threads that have exited
+struct registry {
+  std::mutex                                            mutex;
+  std::unordered_map<const void*, array_report>         totals;
+  static registry& get() {
+    static registry s_registry;
+    return s_registry;
+  }
+  void merge(std::unordered_map<const void*, array_state>& arrays) {
+    std::lock_guard lock(mutex);
+    for (auto& [key, state] : arrays) {
+      if (!state.stats.derefs)
+        continue;
+      auto& total = totals[key];
+      total.name  = state.name;
+      total.stats.merge(state.stats);
+    }
+  }
+};
+
+struct thread_state {
+  std::unordered_map<const void*, array_state> arrays;
+  ~thread_state() { registry::get().merge(arrays); }
+  static thread_state& get() {
+    // Construct the registry first so it outlives every thread_state
+    registry::get();
+    thread_local thread_state s_state;
+    return s_state;
+  }
+};
+
+template <auto ObjectsPtr>
+struct array_key {
+  static constexpr char id = 0;
+};
+
+} // namespace detail
+
+// Called on every dereference when NODECODE_INSTRUMENT is set
+template <auto ObjectsPtr>
+void record(uint64_t index, uintptr_t address) {
+  // Entries are never erased, so the lookup is cached per thread
+  thread_local detail::array_state* s_state = nullptr;
+  if (!s_state) {
+    s_state = &detail::thread_state::get()
+                   .arrays[&detail::array_key<ObjectsPtr>::id];
+    s_state->name = detail::objects_name<ObjectsPtr>();
+  }
+  auto& state = *s_state;
+  ++state.stats.derefs;
+  if (state.hasLast) {
+    if (index >= state.last)
+      ++state.stats.forward[std::bit_width(index - state.last)];
+    else
+      ++state.stats.backward[std::bit_width(state.last - index)];
+  }
+  state.last    = index;
+  state.hasLast = true;
+  state.stats.lines.insert(address / cache_line_size);
+}
+
+// begin + index, recorded unless evaluated at compile time. Cache lines of
+// non-contiguous arrays are estimated from the index.
+template <auto ObjectsPtr, class Iterator, class Index>
+constexpr Iterator deref(Iterator begin, Index index) {
+  Iterator result = begin + index;
+  if (!std::is_constant_evaluated()) {
+    uintptr_t address;
+    if constexpr (std::contiguous_iterator<Iterator>)
+      address = reinterpret_cast<uintptr_t>(std::to_address(result));
+    else
+      address = uintptr_t(index) * sizeof(std::iter_value_t<Iterator>);
+    record<ObjectsPtr>(uint64_t(index), address);
+  }
+  return result;
+}
+
+// Stats of all threads that have exited plus the calling thread. Threads
+// still running are included once they exit, e.g. after
+// parallel_for_each() returns.
+inline std::vector<array_report> report() {
+  std::unordered_map<const void*, array_report> merged;
+  {
+    auto&           reg = detail::registry::get();
+    std::lock_guard lock(reg.mutex);
+    merged = reg.totals;
+  }
+  for (auto& [key, state] : detail::thread_state::get().arrays) {
+    if (!state.stats.derefs)
+      continue;
+    auto& total = merged[key];
+    total.name  = state.name;
+    total.stats.merge(state.stats);
+  }
+  std::vector<array_report> result;
+  for (auto& [key, report] : merged)
+    result.push_back(std::move(report));
+  return result;
+}
+
+// Clears the exited threads' totals and the calling thread's stats
+inline void reset() {
+  {
+    auto&           reg = detail::registry::get();
+    std::lock_guard lock(reg.mutex);
+    reg.totals.clear();
+  }
+  for (auto& [key, state] : detail::thread_state::get().arrays)
+    state = {state.name, {}, 0, false};
+}
+
+// One line per array: derefs, distinct cache lines, then non-empty stride
+// buckets as +k or -k with their counts
+inline void dump(std::ostream& out) {
+  for (auto& [name, stats] : report()) {
+    out << name << ": " << stats.derefs << " derefs, " << stats.lines.size()
+        << " cache lines, strides";
+    if (stats.forward[0])
+      out << " 0:" << stats.forward[0];
+    for (size_t i = 1; i < stride_buckets; ++i) {
+      if (stats.forward[i])
+        out << " +" << i << ":" << stats.forward[i];
+      if (stats.backward[i])
+        out << " -" << i << ":" << stats.backward[i];
+    }
+    out << "\n";
+  }
+}
+
+} // namespace instrument
+
+} // namespace nodecode
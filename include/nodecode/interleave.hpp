@@ -0,0 +1,187 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#pragma once
+
+#include <algorithm>
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <new>
+#include <nodecode/index_ptr.hpp>
+#include <nodecode/prefetch.hpp>
+#include <utility>
+#include <vector>
+
+namespace nodecode {
+
+// Walks interleave() keeps in flight. Each one has at most one cache miss
+// outstanding, so this is roughly the number of misses in flight.
+inline constexpr size_t default_interleave_group = 16;
+
+namespace interleave_detail {
+
+// Coroutine frames of one walk function are all the same size, so freed
+// frames are kept for the next walk rather than returned to the heap
+class frame_cache {
+public:
+  static void* allocate(size_t size) {
+    auto& cache = get();
+    if (cache.m_size == size && !cache.m_frames.empty()) {
+      void* frame = cache.m_frames.back();
+      cache.m_frames.pop_back();
+      return frame;
+    }
+    return ::operator new(size);
+  }
+  static void deallocate(void* frame, size_t size) noexcept {
+    auto& cache = get();
+    if (cache.m_size != size) {
+      cache.clear();
+      cache.m_size = size;
+    }
+    if (cache.m_frames.size() < max_frames) {
+      // Reserved up front, so push_back cannot throw
+      cache.m_frames.push_back(frame);
+      return;
+    }
+    ::operator delete(frame, size);
+  }
+  ~frame_cache() { clear(); }
+
+private:
+  static constexpr size_t max_frames = 256;
+  frame_cache() { m_frames.reserve(max_frames); }
+  static frame_cache& get() {
+    thread_local frame_cache s_cache;
+    return s_cache;
+  }
+  void clear() {
+    for (void* frame : m_frames)
+      ::operator delete(frame, m_size);
+    m_frames.clear();
+  }
+  size_t             m_size = 0;
+  std::vector<void*> m_frames;
+};
+
+} // namespace interleave_detail
+
+// Coroutine type of one walk run by interleave(). Starts suspended.
+class interleaved_task {
+public:
+  struct promise_type {
+    interleaved_task get_return_object() {
+      return interleaved_task(handle_type::from_promise(*this));
+    }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    std::suspend_always final_suspend() noexcept { return {}; }
+    void                return_void() {}
+    void unhandled_exception() { error = std::current_exception(); }
+    static void* operator new(size_t size) {
+      return interleave_detail::frame_cache::allocate(size);
+    }
+    static void operator delete(void* frame, size_t size) noexcept {
+      interleave_detail::frame_cache::deallocate(frame, size);
+    }
+    std::exception_ptr error;
+  };
+  using handle_type = std::coroutine_handle<promise_type>;
+
+  interleaved_task() = default;
+  interleaved_task(const interleaved_task& other) = delete;
+  interleaved_task(interleaved_task&& other) noexcept
+      : m_handle(std::exchange(other.m_handle, nullptr)) {}
+  interleaved_task& operator=(const interleaved_task& other) = delete;
+  interleaved_task& operator=(interleaved_task&& other) noexcept {
+    std::swap(m_handle, other.m_handle);
+    return *this;
+  }
+  ~interleaved_task() {
+    if (m_handle)
+      m_handle.destroy();
+  }
+
+  bool done() const { return !m_handle || m_handle.done(); }
+
+  // Runs to the next co_await fetch() or the end. Rethrows anything the
+  // walk threw.
+  void resume() {
+    m_handle.resume();
+    if (m_handle.done() && m_handle.promise().error)
+      std::rethrow_exception(m_handle.promise().error);
+  }
+
+private:
+  explicit interleaved_task(handle_type handle) : m_handle(handle) {}
+  handle_type m_handle;
+};
+
+// Awaitable returned by fetch()
+template <class T>
+class fetch_awaiter {
+public:
+  explicit fetch_awaiter(T& object) : m_object(&object) {}
+  bool await_ready() const noexcept { return false; }
+  void await_suspend(std::coroutine_handle<>) const noexcept {
+    prefetch(m_object);
+  }
+  T& await_resume() const noexcept { return *m_object; }
+
+private:
+  T* m_object;
+};
+
+// co_await fetch(ptr, header) in an interleaved_task prefetches the target
+// of ptr and lets the other walks run before returning a reference to it.
+// The address is computed without reading the target.
+template <auto ObjectsPtr, class IndexType, bool ConstHeader, class Header>
+auto fetch(const index_ptr<ObjectsPtr, IndexType, ConstHeader>& ptr,
+           Header& header) {
+  return fetch_awaiter(*ptr.bind(header));
+}
+template <auto ObjectsPtr, class IndexType, bool ConstHeader>
+auto fetch(const index_ptr<ObjectsPtr, IndexType, ConstHeader>& ptr) {
+  return fetch_awaiter(*ptr);
+}
+template <class T>
+auto fetch(T* pointer) {
+  return fetch_awaiter(*pointer);
+}
+
+// Runs count walks, make(i) returning the interleaved_task of walk i, with
+// up to group of them in flight on the calling thread. A walk runs until
+// it co_awaits a fetch(), which prefetches and switches to the next walk,
+// so each chain of dependent loads overlaps its misses with the others.
+// make may itself be a coroutine lambda with captures, since it outlives
+// every walk.
+// With no bound_header in scope, pass the header to fetch(). The first
+// exception thrown by a walk is rethrown and walks still in flight are
+// destroyed.
+template <class Make>
+void interleave(size_t count, Make&& make,
+                size_t group = default_interleave_group) {
+  group = std::max(std::min(group, count), size_t(1));
+  std::vector<interleaved_task> slots(group);
+  size_t                        next   = 0;
+  size_t                        active = 0;
+  for (; next < group && next < count; ++next, ++active)
+    slots[next] = make(next);
+  while (active) {
+    for (auto& slot : slots) {
+      if (slot.done())
+        continue;
+      slot.resume();
+      if (!slot.done())
+        continue;
+      if (next < count)
+        slot = make(next++);
+      else {
+        slot = {};
+        --active;
+      }
+    }
+  }
+}
+
+} // namespace nodecode
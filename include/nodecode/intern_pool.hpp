@@ -0,0 +1,192 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <nodecode/index_ptr.hpp>
+#include <ranges>
+#include <shared_mutex>
+#include <stdexcept>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+namespace nodecode {
+
+enum class intern_mode {
+  // Only identical ranges share storage
+  whole,
+  // A range that is a suffix of one already interned shares its tail, e.g.
+  // "world" points into "hello world". Intern longer ranges first to share
+  // the most. Costs a table entry per stored object.
+  suffix,
+};
+
+namespace detail {
+
+// The Header member itself when it can grow, e.g. std::vector or
+// std::string, otherwise a std::vector to copy into it later
+template <auto ObjectsPtr, class Member = std::remove_cvref_t<decltype(
+                               std::declval<member_class_t<decltype(
+                                   ObjectsPtr)>&>().*ObjectsPtr)>>
+using intern_container_t = std::conditional_t<
+    requires(Member& m, const objects_value_t<ObjectsPtr>* p) {
+      m.insert(m.end(), p, p);
+    },
+    Member, std::vector<objects_value_t<ObjectsPtr>>>;
+
+} // namespace detail
+
+// Builds an array of ranges, e.g. the characters behind many
+// index_span<&Header::chars>, storing each distinct range once. intern()
+// returns an index_span to an existing copy if there is one and only
+// appends unseen content. Lookups take a shared lock, so concurrent
+// intern() calls only serialize on misses. Objects already in the array
+// are kept but never matched. Other threads must not touch the array while
+// intern() may be running. That includes forming a range into it to pass
+// to intern(), since a concurrent miss may move the array first, so only
+// pass ranges into the array while no other thread is interning.
+template <auto ObjectsPtr, class IndexType = uint32_t, class SizeType = IndexType>
+class intern_pool {
+public:
+  using value_type     = objects_value_t<ObjectsPtr>;
+  using container_type = detail::intern_container_t<ObjectsPtr>;
+  using span_type      = index_span<ObjectsPtr, IndexType, false, SizeType>;
+
+  explicit intern_pool(container_type& objects,
+                       intern_mode     mode = intern_mode::whole)
+      : m_objects(objects), m_mode(mode) {}
+
+  intern_mode mode() const { return m_mode; }
+
+  // Distinct ranges (and suffixes, in suffix mode) that can be matched
+  size_t entries() const {
+    std::shared_lock lock(m_mutex);
+    return m_entries.size();
+  }
+
+  template <std::ranges::contiguous_range Range>
+  span_type intern(const Range& range) {
+    const value_type* data = std::ranges::data(range);
+    size_t            size = std::ranges::size(range);
+    if (size == 0)
+      return {};
+    // Hashed under the lock: a concurrent miss may reallocate the array,
+    // which a range inside it would still point into. Such a range is
+    // then tracked by its index, which appending does not change.
+    uint64_t hash;
+    bool     inPlace;
+    size_t   index;
+    {
+      std::shared_lock lock(m_mutex);
+      const value_type* base = std::ranges::data(m_objects);
+      inPlace = std::less_equal<>()(base, data) &&
+                std::less_equal<>()(data + size,
+                                    base + std::ranges::size(m_objects));
+      index   = inPlace ? size_t(data - base) : 0;
+      hash    = hash_range(data, size);
+      if (const entry* found = find(hash, data, size))
+        return {found->index, found->size};
+    }
+    std::unique_lock lock(m_mutex);
+    if (inPlace)
+      data = std::ranges::data(m_objects) + index;
+    if (const entry* found = find(hash, data, size))
+      return {found->index, found->size};
+    // A range already inside the array, e.g. a substring of an earlier one,
+    // is registered where it is
+    if (!inPlace)
+      index = std::ranges::size(m_objects);
+    check_fits(index, size);
+    if (!inPlace)
+      m_objects.insert(m_objects.end(), data, data + size);
+    add(std::ranges::data(m_objects) + index, index, size);
+    return {IndexType(index), SizeType(size)};
+  }
+
+  // Reads a null terminated string, e.g. intern("hello")
+  span_type intern(const value_type* str)
+    requires std::is_same_v<value_type, char>
+  {
+    return intern(std::string_view(str));
+  }
+
+private:
+  struct entry {
+    IndexType index;
+    SizeType  size;
+  };
+
+  static void check_fits(size_t index, size_t size) {
+    if (index + size > size_t(std::numeric_limits<IndexType>::max()) ||
+        size > size_t(std::numeric_limits<SizeType>::max()))
+      throw std::out_of_range("Interned range does not fit IndexType");
+  }
+
+  // Polynomial hash evaluated from the back, so the hash of every suffix
+  // falls out of one pass
+  static uint64_t mix(uint64_t h, size_t size) {
+    h ^= uint64_t(size) * 0xbf58476d1ce4e5b9ull;
+    h ^= h >> 31;
+    h *= 0x94d049bb133111ebull;
+    return h ^ (h >> 29);
+  }
+  static uint64_t step(uint64_t h, const value_type& value) {
+    return h * 0x9e3779b97f4a7c15ull + uint64_t(std::hash<value_type>()(value));
+  }
+  static uint64_t hash_range(const value_type* data, size_t size) {
+    uint64_t h = 0;
+    for (size_t i = size; i-- > 0;)
+      h = step(h, data[i]);
+    return mix(h, size);
+  }
+
+  const entry* find(uint64_t hash, const value_type* data, size_t size) const {
+    auto [begin, end] = m_entries.equal_range(hash);
+    const value_type* base = std::ranges::data(m_objects);
+    for (auto it = begin; it != end; ++it) {
+      const entry& e = it->second;
+      if (e.size == size && std::equal(data, data + size, base + e.index))
+        return &e;
+    }
+    return nullptr;
+  }
+
+  // Registers data[0, size) stored at index, plus its suffixes in suffix
+  // mode. Stops at the first suffix already present since all shorter ones
+  // then are too.
+  void add(const value_type* data, size_t index, size_t size) {
+    if (m_mode == intern_mode::whole) {
+      m_entries.emplace(hash_range(data, size),
+                        entry{IndexType(index), SizeType(size)});
+      return;
+    }
+    std::vector<uint64_t> hashes(size);
+    uint64_t              h = 0;
+    for (size_t i = size; i-- > 0;) {
+      h         = step(h, data[i]);
+      hashes[i] = mix(h, size - i);
+    }
+    m_entries.emplace(hashes[0], entry{IndexType(index), SizeType(size)});
+    for (size_t i = 1; i < size; ++i) {
+      if (find(hashes[i], data + i, size - i))
+        break;
+      m_entries.emplace(hashes[i],
+                        entry{IndexType(index + i), SizeType(size - i)});
+    }
+  }
+
+  container_type&                          m_objects;
+  intern_mode                              m_mode;
+  mutable std::shared_mutex                m_mutex;
+  std::unordered_multimap<uint64_t, entry> m_entries;
+};
+
+} // namespace nodecode
@@ -0,0 +1,212 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <fcntl.h>
+#include <filesystem>
+#include <memory>
+#include <nodecode/index_ptr.hpp>
+#include <nodecode/mapped_file.hpp>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <type_traits>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+namespace nodecode {
+
+// Kernel readahead hint applied to a section when it is mapped
+enum class access_advice { normal, sequential, random, willneed };
+
+// An open file shared by the lazy_sections of one lazy_header
+class lazy_file {
+public:
+  explicit lazy_file(const std::filesystem::path& path) {
+    m_fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (m_fd == -1)
+      throw std::runtime_error("Failed to open " + path.string());
+    struct stat st;
+    if (::fstat(m_fd, &st) == -1) {
+      ::close(m_fd);
+      throw std::runtime_error("Failed to stat " + path.string());
+    }
+    m_size = uint64_t(st.st_size);
+  }
+  lazy_file(const lazy_file& other) = delete;
+  lazy_file& operator=(const lazy_file& other) = delete;
+  ~lazy_file() { ::close(m_fd); }
+  int      fd() const { return m_fd; }
+  uint64_t size() const { return m_size; }
+
+  // Reads size bytes at offset, e.g. the directory
+  std::vector<std::byte> read(uint64_t offset, size_t size) const {
+    std::vector<std::byte> result(size);
+    size_t                 done = 0;
+    while (done < size) {
+      ssize_t got = ::pread(m_fd, result.data() + done, size - done,
+                            off_t(offset + done));
+      if (got <= 0)
+        break;
+      done += size_t(got);
+    }
+    result.resize(done);
+    return result;
+  }
+
+private:
+  int      m_fd   = -1;
+  uint64_t m_size = 0;
+};
+
+// Contiguous range over one section of a file that is mapped on first
+// access, e.g. the first index_ptr bind() into it. Until then it holds only
+// the file, offset and count. size() never maps. Mapping is thread safe;
+// racing threads each map and all but one unmap again.
+template <class T>
+class lazy_section {
+public:
+  using value_type = T;
+  lazy_section()   = default;
+  lazy_section(std::shared_ptr<const lazy_file> file, uint64_t offset,
+               size_t count, access_advice advice = access_advice::normal)
+      : m_file(std::move(file)), m_offset(offset), m_count(count),
+        m_advice(advice) {}
+  lazy_section(const lazy_section& other) = delete;
+  lazy_section(lazy_section&& other) noexcept
+      : m_file(std::move(other.m_file)), m_offset(other.m_offset),
+        m_count(other.m_count), m_advice(other.m_advice),
+        m_data(other.m_data.exchange(nullptr)) {}
+  lazy_section& operator=(const lazy_section& other) = delete;
+  lazy_section& operator=(lazy_section&& other) noexcept {
+    unmap(m_data.exchange(other.m_data.exchange(nullptr)));
+    m_file   = std::move(other.m_file);
+    m_offset = other.m_offset;
+    m_count  = other.m_count;
+    m_advice = other.m_advice;
+    return *this;
+  }
+  ~lazy_section() { unmap(m_data.load()); }
+
+  size_t size() const { return m_count; }
+  bool   empty() const { return m_count == 0; }
+  bool   mapped() const { return m_data.load(std::memory_order_acquire); }
+  T*     data() const {
+    T* data = m_data.load(std::memory_order_acquire);
+    return data ? data : map();
+  }
+  // std::span's iterator rather than T*, which the ranges concepts could
+  // not check while T is still incomplete, e.g. inside index_ptr
+  using iterator = typename std::span<T>::iterator;
+  iterator begin() const { return std::span<T>(data(), m_count).begin(); }
+  iterator end() const { return std::span<T>(data(), m_count).end(); }
+  T& operator[](size_t index) const { return data()[index]; }
+
+  // Asks the kernel to read count objects from first ahead of use. Mapping
+  // alone reads nothing, so large sequential scans benefit from this.
+  void willneed(size_t first, size_t count) const {
+    if (first >= m_count)
+      return;
+    count            = std::min(count, m_count - first);
+    auto      base   = reinterpret_cast<uintptr_t>(data() + first);
+    uintptr_t page   = page_size();
+    uintptr_t begin  = base / page * page;
+    uintptr_t end    = base + count * sizeof(T);
+    ::madvise(reinterpret_cast<void*>(begin), end - begin, MADV_WILLNEED);
+  }
+
+private:
+  static uintptr_t page_size() { return uintptr_t(::sysconf(_SC_PAGESIZE)); }
+  // Sections are only aligned to file_section_alignment, so the mapping
+  // starts at the page before and data points into it
+  uint64_t lead() const { return m_offset % page_size(); }
+  T*       map() const {
+    if (m_count == 0)
+      return reinterpret_cast<T*>(alignof(T));
+    uint64_t lead  = this->lead();
+    size_t   bytes = size_t(lead + m_count * sizeof(T));
+    void* base = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                        m_file->fd(), off_t(m_offset - lead));
+    if (base == MAP_FAILED)
+      throw std::runtime_error("Failed to map section");
+    int advice = MADV_NORMAL;
+    switch (m_advice) {
+      case access_advice::sequential: advice = MADV_SEQUENTIAL; break;
+      case access_advice::random: advice = MADV_RANDOM; break;
+      case access_advice::willneed: advice = MADV_WILLNEED; break;
+      default: break;
+    }
+    if (advice != MADV_NORMAL)
+      ::madvise(base, bytes, advice);
+    T* fresh    = reinterpret_cast<T*>(static_cast<std::byte*>(base) + lead);
+    T* expected = nullptr;
+    if (m_data.compare_exchange_strong(expected, fresh,
+                                       std::memory_order_acq_rel,
+                                       std::memory_order_acquire))
+      return fresh;
+    ::munmap(base, bytes);
+    return expected;
+  }
+  void unmap(T* data) {
+    if (!data || m_count == 0)
+      return;
+    uint64_t lead = this->lead();
+    ::munmap(reinterpret_cast<std::byte*>(data) - lead,
+             size_t(lead + m_count * sizeof(T)));
+  }
+
+  std::shared_ptr<const lazy_file> m_file;
+  uint64_t                         m_offset = 0;
+  size_t                           m_count  = 0;
+  access_advice                    m_advice = access_advice::normal;
+  mutable std::atomic<T*>          m_data   = nullptr;
+};
+
+// Opens a file written by write_file() reading only the header and
+// directory. Each Header member must be a lazy_section, mapped privately
+// (copy-on-write) the first time it is accessed, so opening costs the same
+// regardless of file size and untouched arrays are never mapped.
+template <auto... ObjectsPtrs>
+class lazy_header {
+public:
+  using header_type = objects_header_t<ObjectsPtrs...>;
+  explicit lazy_header(const std::filesystem::path& path,
+                       access_advice advice = access_advice::normal)
+      : m_file(std::make_shared<lazy_file>(path)) {
+    auto directory = m_file->read(
+        0, sizeof(file_header) + sizeof(file_section) * sizeof...(ObjectsPtrs));
+    auto   layout = read_layout<ObjectsPtrs...>(directory, m_file->size());
+    size_t i      = 0;
+    (
+        [&] {
+          using value_type = objects_value_t<ObjectsPtrs>;
+          static_assert(
+              std::is_same_v<std::remove_cvref_t<decltype(m_header.*ObjectsPtrs)>,
+                             lazy_section<value_type>>,
+              "lazy_header members must be lazy_sections");
+          auto& section = layout.sections[i++];
+          m_header.*ObjectsPtrs =
+              lazy_section<value_type>(m_file, section.offset,
+                                       size_t(section.count), advice);
+        }(),
+        ...);
+  }
+  header_type&       operator*() { return m_header; }
+  const header_type& operator*() const { return m_header; }
+  header_type*       operator->() { return &m_header; }
+  const header_type* operator->() const { return &m_header; }
+  header_type&       get() { return m_header; }
+  const header_type& get() const { return m_header; }
+
+private:
+  std::shared_ptr<lazy_file> m_file;
+  header_type                m_header;
+};
+
+} // namespace nodecode
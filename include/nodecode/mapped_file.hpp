@@ -0,0 +1,284 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#pragma once
+
+#include <array>
+#include <bit>
+#include <cinttypes>
+#include <cstddef>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <nodecode/index_ptr.hpp>
+#include <ranges>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <type_traits>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+namespace nodecode {
+
+// Files are written in native byte order and mapped without conversion, so
+// the fixed-width integers in the format and every IndexType are only
+// meaningful on little endian hosts.
+static_assert(std::endian::native == std::endian::little,
+              "nodecode file format is little endian");
+
+// On-disk layout, all integers little endian:
+//
+//   file_header
+//   file_section[section_count]   directory, one entry per ObjectsPtr
+//   section 0                     aligned to file_section_alignment
+//   section 1 ...
+//
+// Sections are raw arrays of the Header's value_types. Any index_ptr inside
+// them is just its IndexType, so a mapped file can be traversed as-is.
+inline constexpr std::array<char, 8> file_magic = {'n', 'o', 'd', 'e',
+                                                   'c', 'o', 'd', 'e'};
+inline constexpr uint32_t file_version           = 1;
+inline constexpr uint64_t file_section_alignment = 64;
+
+struct file_header {
+  std::array<char, 8> magic         = file_magic;
+  uint32_t            version       = file_version;
+  uint32_t            section_count = 0;
+  uint64_t            file_size     = 0;
+};
+
+struct file_section {
+  uint64_t offset            = 0;
+  uint64_t count             = 0;
+  uint32_t element_size      = 0;
+  uint32_t element_alignment = 0;
+};
+
+static_assert(sizeof(file_header) == 24);
+static_assert(sizeof(file_section) == 24);
+
+constexpr uint64_t align_up(uint64_t value, uint64_t alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+template <auto ObjectsPtr>
+using objects_value_t = typename index_ptr<ObjectsPtr>::value_type;
+
+// Offsets of each section for the given element counts. Shared by the file
+// writer and anything else producing the same byte layout in memory.
+struct file_layout {
+  file_header               header;
+  std::vector<file_section> sections;
+
+  template <auto... ObjectsPtrs>
+  static file_layout make(const std::array<uint64_t, sizeof...(ObjectsPtrs)>&
+                              counts) {
+    file_layout result;
+    result.header.section_count = sizeof...(ObjectsPtrs);
+    uint64_t offset =
+        sizeof(file_header) + sizeof(file_section) * sizeof...(ObjectsPtrs);
+    size_t i = 0;
+    (
+        [&] {
+          using value_type = objects_value_t<ObjectsPtrs>;
+          static_assert(alignof(value_type) <= file_section_alignment);
+          offset = align_up(offset, file_section_alignment);
+          result.sections.push_back({offset, counts[i],
+                                     uint32_t(sizeof(value_type)),
+                                     uint32_t(alignof(value_type))});
+          offset += counts[i] * sizeof(value_type);
+          ++i;
+        }(),
+        ...);
+    result.header.file_size = offset;
+    return result;
+  }
+
+  // Writes the header and directory to the start of a buffer of at least
+  // header.file_size bytes
+  void write_directory(std::byte* bytes) const {
+    std::memcpy(bytes, &header, sizeof(header));
+    std::memcpy(bytes + sizeof(header), sections.data(),
+                sizeof(file_section) * sections.size());
+  }
+};
+
+// Writes the arrays of a Header to a file loadable with mapped_header. All
+// value_types must be trivially copyable.
+template <auto... ObjectsPtrs>
+void write_file(const std::filesystem::path&                  path,
+                const objects_header_t<ObjectsPtrs...>& header) {
+  static_assert(
+      (std::is_trivially_copyable_v<objects_value_t<ObjectsPtrs>> && ...),
+      "file sections must be trivially copyable");
+  auto layout = file_layout::make<ObjectsPtrs...>(
+      {uint64_t(std::ranges::size(header.*ObjectsPtrs))...});
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  if (!file)
+    throw std::runtime_error("Failed to open " + path.string());
+  std::vector<std::byte> directory(layout.sections.front().offset);
+  layout.write_directory(directory.data());
+  file.write(reinterpret_cast<const char*>(directory.data()),
+             std::streamsize(directory.size()));
+  size_t i = 0;
+  (
+      [&] {
+        auto& section = layout.sections[i++];
+        std::vector<char> padding(section.offset - uint64_t(file.tellp()));
+        file.write(padding.data(), std::streamsize(padding.size()));
+        file.write(
+            reinterpret_cast<const char*>(std::ranges::data(header.*ObjectsPtrs)),
+            std::streamsize(section.count * section.element_size));
+      }(),
+      ...);
+  if (!file)
+    throw std::runtime_error("Failed to write " + path.string());
+}
+
+// Checks the header and directory at the start of a file of fileSize bytes
+// against the value_types of ObjectsPtrs. prefix needs only the header and
+// directory, so sections can be located without reading them.
+template <auto... ObjectsPtrs>
+file_layout read_layout(std::span<const std::byte> prefix, uint64_t fileSize) {
+  file_layout result;
+  auto&       fileHeader = result.header;
+  if (prefix.size() < sizeof(fileHeader))
+    throw std::runtime_error("File too small for header");
+  std::memcpy(&fileHeader, prefix.data(), sizeof(fileHeader));
+  if (fileHeader.magic != file_magic)
+    throw std::runtime_error("Bad file magic");
+  if (fileHeader.version != file_version)
+    throw std::runtime_error("Unsupported file version " +
+                             std::to_string(fileHeader.version));
+  if (fileHeader.section_count != sizeof...(ObjectsPtrs))
+    throw std::runtime_error("Section count mismatch");
+  if (fileHeader.file_size > fileSize)
+    throw std::runtime_error("File truncated");
+  if (sizeof(file_header) + sizeof(file_section) * fileHeader.section_count >
+      prefix.size())
+    throw std::runtime_error("File truncated");
+  size_t i = 0;
+  (
+      [&] {
+        using value_type = objects_value_t<ObjectsPtrs>;
+        file_section section;
+        std::memcpy(&section,
+                    prefix.data() + sizeof(file_header) +
+                        sizeof(file_section) * i++,
+                    sizeof(section));
+        if (section.element_size != sizeof(value_type) ||
+            section.element_alignment != alignof(value_type))
+          throw std::runtime_error("Section element type mismatch");
+        if (section.offset % alignof(value_type) != 0)
+          throw std::runtime_error("Misaligned section");
+        if (section.offset > fileHeader.file_size ||
+            section.count > (fileHeader.file_size - section.offset) /
+                                sizeof(value_type))
+          throw std::runtime_error("Section out of bounds");
+        result.sections.push_back(section);
+      }(),
+      ...);
+  return result;
+}
+
+// Returns a Header whose std::span members point into bytes holding the
+// file layout. Nothing is copied; bytes must outlive the Header. layout must
+// come from read_layout() of the same bytes.
+template <auto... ObjectsPtrs>
+objects_header_t<ObjectsPtrs...> load_header(std::span<std::byte> bytes,
+                                             const file_layout&   layout) {
+  using header_type = objects_header_t<ObjectsPtrs...>;
+  header_type header{};
+  size_t      i = 0;
+  (
+      [&] {
+        using value_type = objects_value_t<ObjectsPtrs>;
+        static_assert(
+            std::is_assignable_v<decltype(header.*ObjectsPtrs),
+                                 std::span<value_type>>,
+            "mapped members must be assignable from std::span");
+        if (reinterpret_cast<uintptr_t>(bytes.data()) % alignof(value_type) != 0)
+          throw std::runtime_error("Misaligned section");
+        const auto& section = layout.sections[i++];
+        header.*ObjectsPtrs = std::span<value_type>(
+            reinterpret_cast<value_type*>(bytes.data() + section.offset),
+            section.count);
+      }(),
+      ...);
+  return header;
+}
+
+template <auto... ObjectsPtrs>
+objects_header_t<ObjectsPtrs...> load_header(std::span<std::byte> bytes) {
+  return load_header<ObjectsPtrs...>(
+      bytes, read_layout<ObjectsPtrs...>(bytes, bytes.size()));
+}
+
+// RAII read-write private (copy-on-write) mapping of a whole file. Pages are
+// faulted in on first access, so opening costs the same regardless of size.
+class mapped_file {
+public:
+  mapped_file() = default;
+  explicit mapped_file(const std::filesystem::path& path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+      throw std::runtime_error("Failed to open " + path.string());
+    struct stat st;
+    if (::fstat(fd, &st) == -1 || st.st_size == 0) {
+      ::close(fd);
+      throw std::runtime_error("Failed to stat " + path.string());
+    }
+    m_size = size_t(st.st_size);
+    void* data =
+        ::mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED)
+      throw std::runtime_error("Failed to map " + path.string());
+    m_data = static_cast<std::byte*>(data);
+  }
+  mapped_file(const mapped_file& other) = delete;
+  mapped_file(mapped_file&& other) noexcept
+      : m_data(std::exchange(other.m_data, nullptr)),
+        m_size(std::exchange(other.m_size, 0)) {}
+  mapped_file& operator=(const mapped_file& other) = delete;
+  mapped_file& operator=(mapped_file&& other) noexcept {
+    std::swap(m_data, other.m_data);
+    std::swap(m_size, other.m_size);
+    return *this;
+  }
+  ~mapped_file() {
+    if (m_data)
+      ::munmap(m_data, m_size);
+  }
+  std::span<std::byte> bytes() const { return {m_data, m_size}; }
+
+private:
+  std::byte* m_data = nullptr;
+  size_t     m_size = 0;
+};
+
+// Maps a file written by write_file() and provides a Header whose spans
+// point into the mapping, ready for index_ptr traversal.
+template <auto... ObjectsPtrs>
+class mapped_header {
+public:
+  using header_type = objects_header_t<ObjectsPtrs...>;
+  explicit mapped_header(const std::filesystem::path& path)
+      : m_file(path), m_header(load_header<ObjectsPtrs...>(m_file.bytes())) {}
+  header_type&       operator*() { return m_header; }
+  const header_type& operator*() const { return m_header; }
+  header_type*       operator->() { return &m_header; }
+  const header_type* operator->() const { return &m_header; }
+  header_type&       get() { return m_header; }
+  const header_type& get() const { return m_header; }
+
+private:
+  mapped_file m_file;
+  header_type m_header;
+};
+
+} // namespace nodecode
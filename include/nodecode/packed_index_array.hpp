@@ -0,0 +1,258 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#pragma once
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstddef>
+#include <iterator>
+#include <nodecode/index_ptr.hpp>
+#include <ranges>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace nodecode {
+
+// An array of index_ptr<ObjectsPtr, IndexType> with each index stored in
+// exactly Bits bits, e.g. 20 bits for a target array of under 2^20 objects.
+// Elements are accessed through proxy references that convert to and
+// dereference like index_ptr. Use unpack() for sequential scans.
+template <auto ObjectsPtr, unsigned Bits, class IndexType = uint32_t>
+class packed_index_array {
+public:
+  static_assert(Bits > 0 && Bits <= 8 * sizeof(IndexType) && Bits <= 64,
+                "Bits must fit in IndexType");
+  using pointer_type = index_ptr<ObjectsPtr, IndexType>;
+  using header_type  = typename pointer_type::header_type;
+  using index_type   = IndexType;
+  using word_type    = uint64_t;
+  using value_type   = pointer_type;
+
+  static constexpr unsigned  bits      = Bits;
+  static constexpr unsigned  word_bits = 64;
+  static constexpr word_type mask =
+      Bits == 64 ? ~word_type(0) : (word_type(1) << Bits) - 1;
+  static constexpr index_type max_index = index_type(mask);
+
+  // Behaves like index_ptr& for a single packed element
+  class reference {
+  public:
+    operator pointer_type() const { return m_array->get(m_pos); }
+    operator index_type() const { return m_array->get(m_pos); }
+    reference& operator=(const index_type& index) {
+      m_array->set(m_pos, index);
+      return *this;
+    }
+    reference& operator=(const reference& other) {
+      return *this = index_type(other);
+    }
+    auto  bind(header_type& header) const { return pointer().bind(header); }
+    auto  get() const { return pointer().get(); }
+    pointer_type pointer() const { return m_array->get(m_pos); }
+    auto& operator*() const { return *get(); }
+    auto* operator->() const { return get().operator->(); }
+
+  private:
+    friend class packed_index_array;
+    reference(packed_index_array* array, size_t pos)
+        : m_array(array), m_pos(pos) {}
+    packed_index_array* m_array;
+    size_t              m_pos;
+  };
+
+  template <bool Const>
+  class basic_iterator {
+  public:
+    using array_type = std::conditional_t<Const, const packed_index_array,
+                                          packed_index_array>;
+    using iterator_concept = std::random_access_iterator_tag;
+    using value_type       = pointer_type;
+    using difference_type  = std::ptrdiff_t;
+    using reference =
+        std::conditional_t<Const, pointer_type, packed_index_array::reference>;
+    basic_iterator() = default;
+    basic_iterator(array_type* array, size_t pos)
+        : m_array(array), m_pos(pos) {}
+    operator basic_iterator<true>() const
+      requires(!Const)
+    {
+      return {m_array, m_pos};
+    }
+    reference operator*() const { return (*m_array)[m_pos]; }
+    reference operator[](difference_type n) const {
+      return (*m_array)[size_t(difference_type(m_pos) + n)];
+    }
+    basic_iterator& operator++() {
+      ++m_pos;
+      return *this;
+    }
+    basic_iterator& operator--() {
+      --m_pos;
+      return *this;
+    }
+    basic_iterator operator++(int) { return {m_array, m_pos++}; }
+    basic_iterator operator--(int) { return {m_array, m_pos--}; }
+    basic_iterator& operator+=(difference_type n) {
+      m_pos = size_t(difference_type(m_pos) + n);
+      return *this;
+    }
+    basic_iterator& operator-=(difference_type n) { return *this += -n; }
+    friend basic_iterator operator+(basic_iterator it, difference_type n) {
+      return it += n;
+    }
+    friend basic_iterator operator+(difference_type n, basic_iterator it) {
+      return it += n;
+    }
+    friend basic_iterator operator-(basic_iterator it, difference_type n) {
+      return it -= n;
+    }
+    friend difference_type operator-(const basic_iterator& a,
+                                     const basic_iterator& b) {
+      return difference_type(a.m_pos) - difference_type(b.m_pos);
+    }
+    bool operator==(const basic_iterator& other) const {
+      return m_pos == other.m_pos;
+    }
+    auto operator<=>(const basic_iterator& other) const {
+      return m_pos <=> other.m_pos;
+    }
+
+  private:
+    array_type* m_array = nullptr;
+    size_t      m_pos   = 0;
+  };
+  using iterator       = basic_iterator<false>;
+  using const_iterator = basic_iterator<true>;
+
+  packed_index_array() = default;
+  explicit packed_index_array(size_t size) { resize(size); }
+  template <class Range>
+    requires std::ranges::input_range<Range>
+  explicit packed_index_array(Range&& indices) {
+    if constexpr (std::ranges::sized_range<Range>)
+      reserve(std::ranges::size(indices));
+    for (auto&& index : indices)
+      push_back(static_cast<index_type>(index));
+  }
+
+  // Throws if index needs more than Bits bits
+  void push_back(const index_type& index) {
+    resize(m_size + 1);
+    set(m_size - 1, index);
+  }
+  // New elements are 0. Bits past size() are kept zero, so growing again
+  // after shrinking does not expose old values.
+  void resize(size_t size) {
+    bool shrink = size < m_size;
+    m_size      = size;
+    // One spare word so reads never need a bounds check. Added words are
+    // value initialized to zero.
+    m_words.resize(words_for(size) + 1);
+    if (shrink) {
+      size_t   bit   = size * Bits;
+      size_t   word  = bit / word_bits;
+      unsigned shift = unsigned(bit % word_bits);
+      m_words[word] &= shift ? ~word_type(0) >> (word_bits - shift) : 0;
+      std::fill(m_words.begin() + ptrdiff_t(word + 1), m_words.end(), 0);
+    }
+  }
+  void reserve(size_t size) { m_words.reserve(words_for(size) + 1); }
+  void clear() { resize(0); }
+
+  index_type get(size_t pos) const {
+    size_t    bit   = pos * Bits;
+    size_t    word  = bit / word_bits;
+    unsigned  shift = unsigned(bit % word_bits);
+    word_type value = m_words[word] >> shift;
+    if (shift + Bits > word_bits)
+      value |= m_words[word + 1] << (word_bits - shift);
+    return index_type(value & mask);
+  }
+  void set(size_t pos, const index_type& index) {
+    if (word_type(index) > mask)
+      throw std::out_of_range("Index does not fit in packed bits");
+    size_t   bit   = pos * Bits;
+    size_t   word  = bit / word_bits;
+    unsigned shift = unsigned(bit % word_bits);
+    m_words[word] = (m_words[word] & ~(mask << shift)) |
+                    (word_type(index) << shift);
+    if (shift + Bits > word_bits) {
+      unsigned low = word_bits - shift;
+      m_words[word + 1] = (m_words[word + 1] & ~(mask >> low)) |
+                          (word_type(index) >> low);
+    }
+  }
+
+  reference      operator[](size_t pos) { return {this, pos}; }
+  pointer_type   operator[](size_t pos) const { return get(pos); }
+  iterator       begin() { return {this, 0}; }
+  iterator       end() { return {this, m_size}; }
+  const_iterator begin() const { return {this, 0}; }
+  const_iterator end() const { return {this, m_size}; }
+  size_t         size() const { return m_size; }
+  bool           empty() const { return m_size == 0; }
+
+  // Packed storage, e.g. to write to a file
+  std::span<const word_type> words() const { return m_words; }
+
+  // Writes out.size() indices starting at first. Aligned blocks of 64
+  // indices span exactly Bits words, so each is decoded with compile time
+  // shifts and masks the compiler can vectorize.
+  template <class T>
+  void unpack(size_t first, std::span<T> out) const {
+    static_assert(std::is_constructible_v<T, index_type>,
+                  "unpack to index_type or index_ptr");
+    size_t count = out.size();
+    if (first > m_size || count > m_size - first)
+      throw std::out_of_range("unpack out of range");
+    T*     dst  = out.data();
+    size_t head = std::min(count, (word_bits - first % word_bits) % word_bits);
+    size_t body = head + (count - head) / word_bits * word_bits;
+    for (size_t i = 0; i < head; ++i)
+      dst[i] = T(get(first + i));
+    for (size_t i = head; i < body; i += word_bits) {
+      // Decoding to a local block keeps GCC's -Warray-bounds quiet about
+      // the fully unrolled stores
+      index_type block[word_bits];
+      unpack_block(&m_words[(first + i) / word_bits * Bits], block,
+                   std::make_integer_sequence<unsigned, word_bits>());
+      std::copy(std::begin(block), std::end(block), dst + i);
+    }
+    for (size_t i = body; i < count; ++i)
+      dst[i] = T(get(first + i));
+  }
+  template <class T>
+  void unpack(std::span<T> out) const {
+    unpack(0, out);
+  }
+
+private:
+  static size_t words_for(size_t size) {
+    return (size * Bits + word_bits - 1) / word_bits;
+  }
+
+  template <unsigned... J>
+  static void unpack_block(const word_type* words, index_type* dst,
+                           std::integer_sequence<unsigned, J...>) {
+    ((dst[J] = unpack_one<J>(words)), ...);
+  }
+
+  template <unsigned J>
+  static index_type unpack_one(const word_type* words) {
+    constexpr size_t   bit   = size_t(J) * Bits;
+    constexpr size_t   word  = bit / word_bits;
+    constexpr unsigned shift = unsigned(bit % word_bits);
+    word_type          value = words[word] >> shift;
+    if constexpr (shift + Bits > word_bits)
+      value |= words[word + 1] << (word_bits - shift);
+    return index_type(value & mask);
+  }
+
+  std::vector<word_type> m_words = std::vector<word_type>(1);
+  size_t                 m_size  = 0;
+};
+
+} // namespace nodecode
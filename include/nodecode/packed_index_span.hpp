@@ -0,0 +1,121 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#pragma once
+
+#include <cinttypes>
+#include <nodecode/index_ptr.hpp>
+#include <ranges>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+
+namespace nodecode {
+
+// An index_span packed into a single WordType: the low SizeBits hold the
+// size and the rest hold the index. Spans too long or too far into the
+// array for that are stored as a full index_span in the OverflowPtr array of
+// the same Header and the word holds an escape size plus the position in
+// OverflowPtr. With the defaults, spans of up to 254 objects in the first
+// 2^24 take 4 bytes instead of 8.
+template <auto ObjectsPtr, auto OverflowPtr, unsigned SizeBits = 8,
+          class WordType = uint32_t, bool ConstHeader = false>
+class packed_index_span {
+public:
+  using span_type    = index_span<ObjectsPtr, WordType, ConstHeader>;
+  using pointer_type = typename span_type::pointer_type;
+  using header_type  = typename span_type::header_type;
+  using value_type   = typename span_type::value_type;
+  using index_type   = WordType;
+  using size_type    = WordType;
+  static_assert(std::is_unsigned_v<WordType>);
+  static_assert(SizeBits > 0 && SizeBits < 8 * sizeof(WordType));
+  static_assert(std::is_same_v<objects_header_t<ObjectsPtr, OverflowPtr>,
+                               typename pointer_type::mutable_header_type>);
+  static_assert(
+      std::is_same_v<
+          std::remove_const_t<typename index_ptr<OverflowPtr>::value_type>,
+          index_span<ObjectsPtr, WordType>>,
+      "OverflowPtr must be an array of index_span<ObjectsPtr, WordType>");
+
+  static constexpr unsigned   size_bits    = SizeBits;
+  static constexpr unsigned   index_bits   = 8 * sizeof(WordType) - SizeBits;
+  static constexpr size_type  escape_size  = size_type((1ull << SizeBits) - 1);
+  static constexpr size_type  max_size     = escape_size - 1;
+  static constexpr index_type max_index =
+      index_type(~index_type(0) >> SizeBits);
+
+  packed_index_span() = default;
+  // Throws if the span does not fit inline. Use make() to fall back to the
+  // overflow array.
+  packed_index_span(const index_type& index, const size_type& size)
+      : m_word(pack(index, size)) {
+    if (!fits_inline(index, size))
+      throw std::out_of_range("Span does not fit in packed bits");
+  }
+
+  static bool fits_inline(const index_type& index, const size_type& size) {
+    return index <= max_index && size <= max_size;
+  }
+
+  // Packs the span inline if possible, otherwise appends it to overflow,
+  // e.g. header_builder::objects<OverflowPtr>()
+  template <class Overflow>
+  static packed_index_span make(const index_type& index, const size_type& size,
+                                Overflow& overflow) {
+    if (fits_inline(index, size))
+      return {index, size};
+    size_t position = std::ranges::size(overflow);
+    if (position > max_index)
+      throw std::out_of_range("Too many overflow spans");
+    overflow.push_back(index_span<ObjectsPtr, WordType>(index, size));
+    packed_index_span result;
+    result.m_word = pack(index_type(position), escape_size);
+    return result;
+  }
+
+  bool is_inline() const { return packed_size() != escape_size; }
+
+  span_type unpack(header_type& header) const {
+    if (is_inline())
+      return {packed_index(), packed_size()};
+    const auto& span = std::ranges::begin(header.*OverflowPtr)[packed_index()];
+    return {span.index(), span.size()};
+  }
+  span_type unpack() const {
+    return unpack(*bound_header<header_type>::get());
+  }
+
+  std::span<value_type> bind(header_type& header) const {
+    auto span = unpack(header);
+    return {std::ranges::begin(header.*ObjectsPtr) + span.index(), span.size()};
+  }
+  std::span<value_type> span() const {
+    return bind(*bound_header<header_type>::get());
+  }
+  // Only long spans need the bound header to find their size
+  size_type   size() const { return is_inline() ? packed_size() : unpack().size(); }
+  value_type* data() const { return unpack().data(); }
+  auto        begin() const { return unpack().begin(); }
+  auto        end() const { return unpack().end(); }
+  value_type& operator[](index_type pos) const { return begin()[pos]; }
+  const WordType& word() const { return m_word; }
+
+  bool operator==(const packed_index_span& other) const {
+    return m_word == other.m_word;
+  }
+  template <class Range>
+  bool operator==(Range&& other) const {
+    return std::ranges::equal(*this, other);
+  }
+
+private:
+  static WordType pack(const index_type& index, const size_type& size) {
+    return WordType(WordType(index) << SizeBits | WordType(size & escape_size));
+  }
+  index_type packed_index() const { return index_type(m_word >> SizeBits); }
+  size_type  packed_size() const { return size_type(m_word & escape_size); }
+
+  WordType m_word = 0;
+};
+
+} // namespace nodecode
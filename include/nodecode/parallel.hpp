@@ -0,0 +1,160 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <nodecode/index_ptr.hpp>
+#include <ranges>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace nodecode {
+
+// bound_header is per thread, so work moved to another thread loses the
+// binding. bound_task() captures the calling thread's binding and returns a
+// callable that restores it around each call, e.g. before handing fn to a
+// thread pool or std::async. A bound_view needs none of this and can be
+// shared between threads as is.
+template <class Header, class Fn>
+auto bound_task(Fn&& fn) {
+  Header* header = bound_header<Header>::get();
+  return [header, fn = std::forward<Fn>(fn)](auto&&... args) mutable {
+    bound_header<Header> bound(*header);
+    return std::invoke(fn, std::forward<decltype(args)>(args)...);
+  };
+}
+
+// Elements handed to a worker at a time. Large enough to amortize the
+// atomic, small enough to balance uneven per-element work.
+inline constexpr size_t default_parallel_chunk = 4096;
+
+// Calls fn(element) for every element of range on all hardware threads,
+// with header bound in each worker. Workers claim chunks of chunkSize
+// elements from a shared counter, so a worker that finishes early takes
+// more. The first exception thrown by fn is rethrown once all workers stop.
+// The range is evaluated in the calling thread with header bound, so it
+// may be an index_span.
+template <class Header, std::ranges::random_access_range Range, class Fn>
+  requires std::ranges::sized_range<Range>
+void parallel_for_each(Header& header, Range&& range, Fn&& fn,
+                       size_t chunkSize = default_parallel_chunk,
+                       size_t threadCount = std::thread::hardware_concurrency()) {
+  bound_header<Header> bound(header);
+  auto                 first = std::ranges::begin(range);
+  size_t               size  = size_t(std::ranges::size(range));
+  chunkSize                  = std::max(chunkSize, size_t(1));
+  size_t chunks              = (size + chunkSize - 1) / chunkSize;
+  threadCount = std::clamp(threadCount, size_t(1), std::max(chunks, size_t(1)));
+
+  std::atomic<size_t> next = 0;
+  std::atomic<bool>   failed = false;
+  std::exception_ptr  error;
+  std::mutex          errorMutex;
+  auto                worker = [&] {
+    bound_header<Header> workerBound(header);
+    try {
+      while (!failed.load(std::memory_order_relaxed)) {
+        size_t chunk = next.fetch_add(1, std::memory_order_relaxed);
+        if (chunk >= chunks)
+          break;
+        size_t begin = chunk * chunkSize;
+        size_t end   = std::min(begin + chunkSize, size);
+        for (size_t i = begin; i < end; ++i)
+          std::invoke(fn, first[std::ranges::range_difference_t<Range>(i)]);
+      }
+    } catch (...) {
+      std::lock_guard lock(errorMutex);
+      if (!error)
+        error = std::current_exception();
+      failed = true;
+    }
+  };
+
+  // The calling thread is one of the workers
+  std::vector<std::thread> threads;
+  threads.reserve(threadCount - 1);
+  for (size_t i = 1; i < threadCount; ++i) {
+    // Carry on with fewer workers if the system refuses more threads
+    try {
+      threads.emplace_back(worker);
+    } catch (const std::system_error&) {
+      break;
+    }
+  }
+  worker();
+  for (auto& thread : threads)
+    thread.join();
+  if (error)
+    std::rethrow_exception(error);
+}
+
+// Stable parallel counting sort of entries into buckets, without atomics.
+// Entries come from chunks processed in parallel; within a bucket, entries
+// of earlier chunks come first and each chunk's keep their order. Used to
+// group random accesses by a cache sized block of their target. Both
+// passes take forChunk(chunk, fn), which must call fn(bucket) for each
+// entry of chunk in the same order every time.
+class radix_partition {
+public:
+  // Counts the entries of each bucket. fn is add(bucket).
+  template <class Header, class ForChunk>
+  radix_partition(Header& header, size_t chunks, size_t buckets,
+                  ForChunk&& forChunk,
+                  size_t threadCount = std::thread::hardware_concurrency())
+      : m_buckets(buckets), m_threadCount(std::max(threadCount, size_t(1))),
+        m_offsets(chunks * buckets), m_begin(buckets + 1) {
+    // m_offsets[chunk * buckets + b] is where chunk's entries in bucket b go
+    for_chunks(header, [&](size_t chunk) {
+      size_t* counts = m_offsets.data() + chunk * m_buckets;
+      forChunk(chunk, [counts](size_t bucket) { ++counts[bucket]; });
+    });
+    size_t total = 0;
+    for (size_t b = 0; b < buckets; ++b) {
+      m_begin[b] = total;
+      for (size_t chunk = 0; chunk < chunks; ++chunk)
+        total += std::exchange(m_offsets[chunk * buckets + b], total);
+    }
+    m_begin[buckets] = total;
+  }
+
+  size_t size() const { return m_begin.back(); }
+  size_t buckets() const { return m_buckets; }
+  size_t begin(size_t bucket) const { return m_begin[bucket]; }
+  size_t end(size_t bucket) const { return m_begin[bucket + 1]; }
+
+  // Visits the entries again. fn is next(bucket), returning the entry's
+  // position in bucket order, so the caller writes it there. May be
+  // repeated, e.g. to read results back in the original order.
+  template <class Header, class ForChunk>
+  void scatter(Header& header, ForChunk&& forChunk) const {
+    for_chunks(header, [&](size_t chunk) {
+      std::vector<size_t> cursor(
+          m_offsets.begin() + ptrdiff_t(chunk * m_buckets),
+          m_offsets.begin() + ptrdiff_t((chunk + 1) * m_buckets));
+      forChunk(chunk, [&cursor](size_t bucket) { return cursor[bucket]++; });
+    });
+  }
+
+private:
+  template <class Header, class Fn>
+  void for_chunks(Header& header, Fn&& fn) const {
+    size_t chunks = m_buckets ? m_offsets.size() / m_buckets : 0;
+    parallel_for_each(header, std::views::iota(size_t(0), chunks), fn, 1,
+                      m_threadCount);
+  }
+
+  size_t              m_buckets;
+  size_t              m_threadCount;
+  std::vector<size_t> m_offsets;
+  std::vector<size_t> m_begin;
+};
+
+} // namespace nodecode
@@ -0,0 +1,120 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <memory>
+#include <nodecode/gather.hpp>
+#include <nodecode/index_ptr.hpp>
+#include <nodecode/parallel.hpp>
+#include <ranges>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace nodecode {
+
+// Bytes of the target array handled together by partitioned_gather(),
+// sized to stay in L2 along with its share of the requests
+inline constexpr size_t default_partition_bytes = size_t(1) << 18;
+
+// Most regions partitioned_gather() splits the target array into. Each is
+// a write stream in the partition pass, and more streams than this thrash
+// the TLB that partitioning is meant to spare.
+inline constexpr size_t max_partitions = 256;
+
+// gather() for random indices into an array much larger than the last level
+// cache. Requests are radix partitioned by the region of the target array
+// they fall in, each region is gathered while it is cache and TLB resident,
+// and results are replayed back into request order. Every pass is parallel.
+// Costs a few sequential passes over the requests, so it only wins once
+// the target array is well past the cache; small arrays go straight to
+// gather(). Every request is bounds checked before anything is written,
+// throwing std::out_of_range, on either path.
+template <std::ranges::contiguous_range Ptrs, class Out>
+  requires std::ranges::contiguous_range<Out>
+void partitioned_gather(const Ptrs&                                   ptrs,
+                        typename gather_pointer_t<Ptrs>::header_type& header,
+                        Out&& out, size_t regionBytes = default_partition_bytes,
+                        size_t threadCount = std::thread::hardware_concurrency()) {
+  using pointer_type = gather_pointer_t<Ptrs>;
+  using value_type   = std::remove_const_t<typename pointer_type::value_type>;
+  using index_type   = typename pointer_type::index_type;
+  static_assert(sizeof(pointer_type) == sizeof(index_type));
+  static_assert(std::is_trivially_copyable_v<value_type> &&
+                    std::is_default_constructible_v<value_type>,
+                "partitioned_gather buffers values");
+  size_t size = std::ranges::size(ptrs);
+  if (std::ranges::size(out) < size)
+    throw std::out_of_range("gather output too small");
+  auto&  objects     = header.*pointer_type::objects_ptr;
+  size_t objectCount = std::ranges::size(objects);
+
+  // Region of index i is i >> shift
+  size_t regionObjects = std::max(regionBytes / sizeof(value_type), size_t(1));
+  unsigned shift       = unsigned(std::bit_width(regionObjects) - 1);
+  while ((objectCount >> shift) + 1 > max_partitions)
+    ++shift;
+  size_t      regions = (objectCount >> shift) + 1;
+  const auto* src     = std::ranges::data(ptrs);
+  if (regions <= 2) {
+    // Checked like the partitioned path, so a bad index throws whatever
+    // the array size
+    for (size_t i = 0; i < size; ++i)
+      if (size_t(static_cast<const index_type&>(src[i])) >= objectCount)
+        throw std::out_of_range("index_ptr out of range");
+    gather(ptrs, header, out);
+    return;
+  }
+
+  auto*       dst   = std::ranges::data(out);
+  const auto* base  = std::ranges::data(objects);
+  threadCount       = std::max(threadCount, size_t(1));
+  size_t chunks     = std::clamp(size / default_parallel_chunk, size_t(1),
+                                 threadCount * 4);
+  size_t chunkSize  = (size + chunks - 1) / chunks;
+  auto   forChunk   = [&](size_t chunk, auto&& fn) {
+    size_t end = std::min((chunk + 1) * chunkSize, size);
+    for (size_t i = chunk * chunkSize; i < end; ++i)
+      fn(i, size_t(static_cast<const index_type&>(src[i])));
+  };
+
+  radix_partition partition(
+      header, chunks, regions,
+      [&](size_t chunk, auto&& add) {
+        forChunk(chunk, [&](size_t, size_t index) {
+          // Later passes trust the region to index their cursors
+          if (index >= objectCount)
+            throw std::out_of_range("index_ptr out of range");
+          add(index >> shift);
+        });
+      },
+      threadCount);
+
+  // Not value initialized; every element is written before it is read
+  std::unique_ptr<index_type[]> partitioned(new index_type[size]);
+  std::unique_ptr<value_type[]> values(new value_type[size]);
+  partition.scatter(header, [&](size_t chunk, auto&& next) {
+    forChunk(chunk, [&](size_t, size_t index) {
+      partitioned[next(index >> shift)] = index_type(index);
+    });
+  });
+  parallel_for_each(
+      header, std::views::iota(size_t(0), regions),
+      [&](size_t r) {
+        for (size_t k = partition.begin(r); k < partition.end(r); ++k)
+          values[k] = base[partitioned[k]];
+      },
+      1, threadCount);
+  // Replaying the partition order reads each region's values sequentially
+  partition.scatter(header, [&](size_t chunk, auto&& next) {
+    forChunk(chunk, [&](size_t i, size_t index) {
+      dst[i] = values[next(index >> shift)];
+    });
+  });
+}
+
+} // namespace nodecode
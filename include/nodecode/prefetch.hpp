@@ -0,0 +1,117 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#pragma once
+
+#include <cstddef>
+#include <iterator>
+#include <nodecode/index_ptr.hpp>
+#include <ranges>
+#include <type_traits>
+
+#if defined(_MSC_VER) && !defined(__clang__)
+  #include <intrin.h>
+#endif
+
+namespace nodecode {
+
+// Hint that address will be read soon. Does nothing on unknown compilers.
+// prefetch_view and fetch() call prefetch() unqualified, so an overload for
+// a pointer to a specific type, in that type's namespace, replaces this one,
+// e.g. to prefetch every cache line of a large object.
+inline void prefetch(const void* address) {
+#if defined(__GNUC__) || defined(__clang__)
+  __builtin_prefetch(address, 0, 3);
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+  _mm_prefetch(static_cast<const char*>(address), _MM_HINT_T0);
+#else
+  (void)address;
+#endif
+}
+
+// Enough independent misses in flight to saturate DRAM when the per-element
+// work is small. Loops doing more work per element want less.
+inline constexpr size_t default_prefetch_distance = 64;
+
+// A view of the objects targeted by a contiguous range of index_ptr. While
+// yielding the target of element i, it prefetches the target of element
+// i + distance(), hiding the cache miss of each dereference behind the work
+// done on the previous ones. Like bound_view, the target array is looked up
+// once, so the view is invalidated if the array is reallocated.
+template <std::ranges::contiguous_range Ptrs>
+class prefetch_view
+    : public std::ranges::view_interface<prefetch_view<Ptrs>> {
+public:
+  using pointer_type = std::remove_cvref_t<std::ranges::range_value_t<Ptrs>>;
+  using header_type  = typename pointer_type::header_type;
+  using value_type   = typename pointer_type::value_type;
+  using index_type   = typename pointer_type::index_type;
+
+  class iterator {
+  public:
+    using iterator_concept = std::forward_iterator_tag;
+    using value_type       = std::remove_cv_t<prefetch_view::value_type>;
+    using difference_type  = std::ptrdiff_t;
+    iterator() = default;
+    iterator(const pointer_type* ptr, const pointer_type* end,
+             prefetch_view::value_type* base, size_t distance)
+        : m_ptr(ptr), m_end(end), m_base(base), m_distance(distance) {}
+    prefetch_view::value_type& operator*() const {
+      return m_base[static_cast<const index_type&>(*m_ptr)];
+    }
+    // Targets [i, i + distance) have been prefetched at element i, so
+    // moving to i + 1 prefetches i + distance
+    iterator& operator++() {
+      if (m_distance && size_t(m_end - m_ptr) > m_distance)
+        prefetch(m_base + static_cast<const index_type&>(m_ptr[m_distance]));
+      ++m_ptr;
+      return *this;
+    }
+    iterator operator++(int) {
+      iterator result = *this;
+      ++*this;
+      return result;
+    }
+    bool operator==(const iterator& other) const {
+      return m_ptr == other.m_ptr;
+    }
+    // Position in the underlying range of index_ptr
+    const pointer_type& pointer() const { return *m_ptr; }
+
+  private:
+    const pointer_type*        m_ptr  = nullptr;
+    const pointer_type*        m_end  = nullptr;
+    prefetch_view::value_type* m_base = nullptr;
+    size_t                     m_distance = 0;
+  };
+
+  prefetch_view() = default;
+  prefetch_view(const Ptrs& ptrs, header_type& header,
+                size_t distance = default_prefetch_distance)
+      : m_ptrs(std::ranges::data(ptrs)), m_size(std::ranges::size(ptrs)),
+        m_base(std::ranges::data(header.*pointer_type::objects_ptr)),
+        m_distance(distance) {}
+
+  // Prefetches the first distance() targets before returning
+  iterator begin() const {
+    for (size_t i = 0; i < m_distance && i < m_size; ++i)
+      prefetch(m_base + static_cast<const index_type&>(m_ptrs[i]));
+    return {m_ptrs, m_ptrs + m_size, m_base, m_distance};
+  }
+  iterator end() const {
+    return {m_ptrs + m_size, m_ptrs + m_size, m_base, m_distance};
+  }
+  size_t size() const { return m_size; }
+  size_t distance() const { return m_distance; }
+
+  // Tune the lookahead, e.g. from a measured miss latency. Takes effect on
+  // the next begin().
+  void set_distance(size_t distance) { m_distance = distance; }
+
+private:
+  const pointer_type* m_ptrs     = nullptr;
+  size_t              m_size     = 0;
+  value_type*         m_base     = nullptr;
+  size_t              m_distance = default_prefetch_distance;
+};
+
+} // namespace nodecode
@@ -0,0 +1,159 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#pragma once
+
+#include <cstddef>
+#include <nodecode/index_ptr.hpp>
+#include <nodecode/parallel.hpp>
+#include <ranges>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace nodecode {
+
+namespace relayout_detail {
+
+// newIndex entry of an object that no longer exists, e.g. after compact()
+inline constexpr size_t removed_index = size_t(-1);
+
+// ref under newIndex. Throws without writing anything, so every reference
+// can be checked before the first is rewritten.
+template <auto TargetPtr, class Ref>
+Ref remapped(const Ref& ref, const std::vector<size_t>& newIndex) {
+  static_assert(is_index_ptr_v<Ref> || is_index_span_v<Ref>,
+                "index_refs must name index_ptr or index_span objects");
+  static_assert(same_member<Ref::objects_ptr, TargetPtr>(),
+                "index_refs must point into the relayout array");
+  using index_type = typename Ref::index_type;
+  if constexpr (is_index_ptr_v<Ref>) {
+    size_t index = static_cast<const index_type&>(ref);
+    if (index >= newIndex.size())
+      throw std::out_of_range("index_ptr out of range");
+    if (newIndex[index] == removed_index)
+      throw std::invalid_argument("index_ptr to a removed object");
+    return Ref(static_cast<index_type>(newIndex[index]));
+  } else {
+    size_t index = ref.index(), size = ref.size();
+    if (size == 0)
+      return ref;
+    if (index > newIndex.size() || size > newIndex.size() - index)
+      throw std::out_of_range("index_span out of range");
+    size_t first = newIndex[index];
+    if (first == removed_index)
+      throw std::invalid_argument("index_span over a removed object");
+    for (size_t i = 1; i < size; ++i)
+      if (newIndex[index + i] != first + i)
+        throw std::invalid_argument(newIndex[index + i] == removed_index
+                                        ? "index_span over a removed object"
+                                        : "order splits an index_span");
+    return Ref(static_cast<index_type>(first), ref.size());
+  }
+}
+
+// Checks every reference named by index_refs against newIndex, then, with
+// Write, rewrites them. Only the checking pass throws.
+template <auto TargetPtr, bool Write, class Header, auto ArrayPtr,
+          auto... MemberPtr>
+void remap_all(Header& header, index_refs<ArrayPtr, MemberPtr...>,
+               const std::vector<size_t>& newIndex, size_t chunkSize,
+               size_t threadCount) {
+  auto remap = [&](auto& ref) {
+    auto result = remapped<TargetPtr>(ref, newIndex);
+    if constexpr (Write)
+      ref = result;
+  };
+  auto remapElement = [&](auto& element) {
+    remap(ref_of<MemberPtr...>(element));
+  };
+  if constexpr (same_member<ArrayPtr, TargetPtr>()) {
+    // References held by removed objects are dropped with them
+    auto first = std::ranges::begin(header.*ArrayPtr);
+    parallel_for_each(
+        header, std::views::iota(size_t(0), newIndex.size()),
+        [&](size_t i) {
+          if (newIndex[i] != removed_index)
+            remapElement(first[ptrdiff_t(i)]);
+        },
+        chunkSize, threadCount);
+  } else {
+    parallel_for_each(header, header.*ArrayPtr, remapElement, chunkSize,
+                      threadCount);
+  }
+}
+
+// Rewrites every reference in Refs for newIndex. All are checked in
+// parallel before the first is written, so a throw changes nothing.
+template <auto TargetPtr, class... Refs, class Header>
+void remap_refs(Header& header, const std::vector<size_t>& newIndex,
+                size_t chunkSize, size_t threadCount) {
+  (remap_all<TargetPtr, false>(header, Refs{}, newIndex, chunkSize,
+                               threadCount),
+   ...);
+  (remap_all<TargetPtr, true>(header, Refs{}, newIndex, chunkSize,
+                              threadCount),
+   ...);
+}
+
+} // namespace relayout_detail
+
+// Moves object order[i] of header.*TargetPtr to position i and rewrites
+// every reference listed in Refs to match. Each Refs is an
+// index_refs<>. Spans must stay contiguous under the new order or
+// std::invalid_argument is thrown. Every reference is checked in parallel
+// before any is rewritten or any object moves, so a throw leaves the
+// header unchanged.
+template <auto TargetPtr, class... Refs, class Header>
+void relayout(Header& header, const std::vector<size_t>& order,
+              size_t chunkSize   = default_parallel_chunk,
+              size_t threadCount = std::thread::hardware_concurrency()) {
+  auto&  objects = header.*TargetPtr;
+  size_t size    = std::ranges::size(objects);
+  if (order.size() != size)
+    throw std::invalid_argument("order must list every object once");
+  std::vector<size_t> newIndex(size, size);
+  for (size_t i = 0; i < size; ++i) {
+    if (order[i] >= size || newIndex[order[i]] != size)
+      throw std::invalid_argument("order must list every object once");
+    newIndex[order[i]] = i;
+  }
+  relayout_detail::remap_refs<TargetPtr, Refs...>(header, newIndex, chunkSize,
+                                                 threadCount);
+  using value_type =
+      std::remove_reference_t<std::ranges::range_reference_t<decltype(objects)>>;
+  std::vector<value_type> permuted;
+  permuted.reserve(size);
+  auto begin = std::ranges::begin(objects);
+  for (size_t i : order)
+    permuted.push_back(std::move(begin[i]));
+  std::ranges::move(permuted, begin);
+}
+
+// Breadth first order of size objects starting from roots, for relayout().
+// neighbors(i) returns the indices reachable from object i. Objects never
+// reached keep their relative order at the end.
+template <class Roots, class Neighbors>
+std::vector<size_t> bfs_order(size_t size, const Roots& roots,
+                              Neighbors&& neighbors) {
+  std::vector<size_t> order;
+  std::vector<bool>   visited(size);
+  order.reserve(size);
+  auto visit = [&](size_t i) {
+    if (i < size && !visited[i]) {
+      visited[i] = true;
+      order.push_back(i);
+    }
+  };
+  for (auto root : roots)
+    visit(size_t(root));
+  for (size_t head = 0; head < order.size(); ++head)
+    for (auto next : neighbors(order[head]))
+      visit(size_t(next));
+  for (size_t i = 0; i < size; ++i)
+    visit(i);
+  return order;
+}
+
+} // namespace nodecode
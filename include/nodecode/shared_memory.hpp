@@ -0,0 +1,347 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <fcntl.h>
+#include <new>
+#include <nodecode/index_ptr.hpp>
+#include <nodecode/mapped_file.hpp>
+#include <ranges>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <type_traits>
+#include <unistd.h>
+#include <utility>
+
+namespace nodecode {
+
+// Array counts are shared between processes through std::atomic_ref, which
+// is only address free when lock free
+static_assert(std::atomic_ref<uint64_t>::is_always_lock_free);
+
+enum class shared_access { read_only, read_write };
+
+namespace shared_memory_detail {
+
+// A segment is the file layout followed by one reserved count per array,
+// the objects claimed by allocate(). The count in each file_section is the
+// committed count, objects already written, which is all readers see.
+inline uint64_t reserved_offset(uint64_t fileSize) {
+  return align_up(fileSize, file_section_alignment);
+}
+inline uint64_t segment_size(uint64_t fileSize, size_t sectionCount) {
+  return reserved_offset(fileSize) + sizeof(uint64_t) * sectionCount;
+}
+
+} // namespace shared_memory_detail
+
+// RAII MAP_SHARED mapping of a POSIX shared memory object or a memfd. Every
+// process maps it at its own address; index_ptr makes that harmless.
+class shared_segment {
+public:
+  shared_segment() = default;
+
+  // Creates a new named object, e.g. "/graph", of size zero filled bytes.
+  // Throws if the name already exists.
+  static shared_segment create(const std::string& name, size_t size) {
+    int fd = ::shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC,
+                        0600);
+    if (fd == -1)
+      throw std::runtime_error("Failed to create shared memory " + name);
+    if (::ftruncate(fd, off_t(size)) == -1) {
+      ::close(fd);
+      ::shm_unlink(name.c_str());
+      throw std::runtime_error("Failed to size shared memory " + name);
+    }
+    return shared_segment(fd, size, shared_access::read_write);
+  }
+
+  // Attaches to an object made by create() in any process
+  static shared_segment open(const std::string& name, shared_access access) {
+    int fd = ::shm_open(name.c_str(),
+                        (access == shared_access::read_only ? O_RDONLY
+                                                            : O_RDWR) |
+                            O_CLOEXEC,
+                        0);
+    if (fd == -1)
+      throw std::runtime_error("Failed to open shared memory " + name);
+    return shared_segment(fd, file_size(fd), access);
+  }
+
+  // Creates an unnamed object, shared with child processes or by passing
+  // fd() over a unix socket
+  static shared_segment anonymous(size_t size) {
+    int fd = ::memfd_create("nodecode", MFD_CLOEXEC);
+    if (fd == -1)
+      throw std::runtime_error("Failed to create memfd");
+    if (::ftruncate(fd, off_t(size)) == -1) {
+      ::close(fd);
+      throw std::runtime_error("Failed to size memfd");
+    }
+    return shared_segment(fd, size, shared_access::read_write);
+  }
+
+  // Attaches to a duplicate of fd, e.g. one received from another process
+  static shared_segment attach(int fd, shared_access access) {
+    int copy = ::fcntl(fd, F_DUPFD_CLOEXEC, 0);
+    if (copy == -1)
+      throw std::runtime_error("Failed to duplicate shared memory fd");
+    return shared_segment(copy, file_size(copy), access);
+  }
+
+  // Removes the name. Mapped segments stay valid until unmapped.
+  static void unlink(const std::string& name) { ::shm_unlink(name.c_str()); }
+
+  shared_segment(const shared_segment& other) = delete;
+  shared_segment(shared_segment&& other) noexcept
+      : m_fd(std::exchange(other.m_fd, -1)),
+        m_data(std::exchange(other.m_data, nullptr)),
+        m_size(std::exchange(other.m_size, 0)), m_access(other.m_access) {}
+  shared_segment& operator=(const shared_segment& other) = delete;
+  shared_segment& operator=(shared_segment&& other) noexcept {
+    std::swap(m_fd, other.m_fd);
+    std::swap(m_data, other.m_data);
+    std::swap(m_size, other.m_size);
+    std::swap(m_access, other.m_access);
+    return *this;
+  }
+  ~shared_segment() {
+    if (m_data)
+      ::munmap(m_data, m_size);
+    if (m_fd != -1)
+      ::close(m_fd);
+  }
+  std::span<std::byte> bytes() const { return {m_data, m_size}; }
+  int                  fd() const { return m_fd; }
+  shared_access        access() const { return m_access; }
+
+private:
+  shared_segment(int fd, size_t size, shared_access access)
+      : m_fd(fd), m_size(size), m_access(access) {
+    int   prot = PROT_READ | (access == shared_access::read_write ? PROT_WRITE : 0);
+    void* data = size ? ::mmap(nullptr, size, prot, MAP_SHARED, fd, 0)
+                      : MAP_FAILED;
+    if (data == MAP_FAILED) {
+      ::close(fd);
+      throw std::runtime_error("Failed to map shared memory");
+    }
+    m_data = static_cast<std::byte*>(data);
+  }
+  static size_t file_size(int fd) {
+    struct stat st;
+    if (::fstat(fd, &st) == -1) {
+      ::close(fd);
+      throw std::runtime_error("Failed to stat shared memory");
+    }
+    return size_t(st.st_size);
+  }
+
+  int           m_fd     = -1;
+  std::byte*    m_data   = nullptr;
+  size_t        m_size   = 0;
+  shared_access m_access = shared_access::read_only;
+};
+
+// Places a Header's arrays in a new segment, in the write_file() layout, with
+// room for capacities[i] objects in array i or its current size if larger.
+// An empty name makes an anonymous memfd segment. Unused capacity only costs
+// address space until written.
+template <auto... ObjectsPtrs>
+shared_segment
+make_shared_segment(const std::string&                      name,
+                    const objects_header_t<ObjectsPtrs...>& header,
+                    const std::array<uint64_t, sizeof...(ObjectsPtrs)>&
+                        capacities = {}) {
+  static_assert(
+      (std::is_trivially_copyable_v<objects_value_t<ObjectsPtrs>> && ...),
+      "shared arrays must be trivially copyable");
+  std::array<uint64_t, sizeof...(ObjectsPtrs)> counts{
+      uint64_t(std::ranges::size(header.*ObjectsPtrs))...};
+  std::array<uint64_t, sizeof...(ObjectsPtrs)> reserved;
+  for (size_t i = 0; i < counts.size(); ++i)
+    reserved[i] = std::max(counts[i], capacities[i]);
+  auto layout = file_layout::make<ObjectsPtrs...>(reserved);
+  for (size_t i = 0; i < counts.size(); ++i)
+    layout.sections[i].count = counts[i];
+  size_t segmentSize = shared_memory_detail::segment_size(
+      layout.header.file_size, counts.size());
+  shared_segment segment = name.empty()
+                               ? shared_segment::anonymous(segmentSize)
+                               : shared_segment::create(name, segmentSize);
+  std::byte* bytes = segment.bytes().data();
+  layout.write_directory(bytes);
+  std::memcpy(bytes + shared_memory_detail::reserved_offset(
+                          layout.header.file_size),
+              counts.data(), sizeof(counts));
+  size_t i = 0;
+  (
+      [&] {
+        auto& section = layout.sections[i++];
+        std::memcpy(bytes + section.offset,
+                    std::ranges::data(header.*ObjectsPtrs),
+                    section.count * section.element_size);
+      }(),
+      ...);
+  return segment;
+}
+
+// Objects reserved by shared_header::allocate()
+template <class T>
+struct shared_allocation {
+  size_t       index;
+  std::span<T> objects;
+};
+
+// A Header attached to a segment from make_shared_segment(). Its std::span
+// members point into the segment, ready for index_ptr traversal, in whichever
+// process attached it. allocate() grows an array in place from any process
+// and commit() publishes the objects once written; the spans of every
+// attachment see committed objects after refresh().
+template <auto... ObjectsPtrs>
+class shared_header {
+public:
+  using header_type = objects_header_t<ObjectsPtrs...>;
+  explicit shared_header(shared_segment segment)
+      : m_segment(std::move(segment)), m_header(load()) {}
+  header_type&       operator*() { return m_header; }
+  const header_type& operator*() const { return m_header; }
+  header_type*       operator->() { return &m_header; }
+  const header_type* operator->() const { return &m_header; }
+  header_type&       get() { return m_header; }
+  const header_type& get() const { return m_header; }
+  const shared_segment& segment() const { return m_segment; }
+
+  // Objects array ObjectsPtr has room for
+  template <auto ObjectsPtr>
+  size_t capacity() const {
+    constexpr size_t i = objects_index<ObjectsPtr, ObjectsPtrs...>();
+    static_assert(i < sizeof...(ObjectsPtrs), "ObjectsPtr not in shared_header");
+    auto   section = read_section(i);
+    size_t end     = i + 1 < sizeof...(ObjectsPtrs) ? read_section(i + 1).offset
+                                                    : file_size();
+    return (end - section.offset) / section.element_size;
+  }
+
+  // Reserves count zeroed objects at the end of array ObjectsPtr, safe
+  // against other threads and processes doing the same. Throws
+  // std::bad_alloc if the array is at capacity. No attachment sees the
+  // objects, even after refresh(), until they are passed to commit().
+  template <auto ObjectsPtr>
+  shared_allocation<objects_value_t<ObjectsPtr>> allocate(size_t count) {
+    using value_type   = objects_value_t<ObjectsPtr>;
+    constexpr size_t i = objects_index<ObjectsPtr, ObjectsPtrs...>();
+    static_assert(i < sizeof...(ObjectsPtrs), "ObjectsPtr not in shared_header");
+    if (m_segment.access() != shared_access::read_write)
+      throw std::logic_error("allocate() on a read only shared_header");
+    size_t                    limit = capacity<ObjectsPtr>();
+    std::atomic_ref<uint64_t> reserved(reserved_of(i));
+    uint64_t                  first = reserved.load();
+    do {
+      if (count > limit - first)
+        throw std::bad_alloc();
+    } while (!reserved.compare_exchange_weak(first, first + count));
+    auto* base = reinterpret_cast<value_type*>(m_segment.bytes().data() +
+                                               read_section(i).offset);
+    return {first, std::span<value_type>(base + first, count)};
+  }
+
+  // Publishes the written objects of an allocation. Allocations are
+  // committed in the order they were made, so this waits for every earlier
+  // allocation of the array to be committed first, which never happens if
+  // its process exits before committing.
+  template <auto ObjectsPtr>
+  void commit(const shared_allocation<objects_value_t<ObjectsPtr>>& allocation) {
+    constexpr size_t i = objects_index<ObjectsPtr, ObjectsPtrs...>();
+    static_assert(i < sizeof...(ObjectsPtrs), "ObjectsPtr not in shared_header");
+    std::atomic_ref<uint64_t> committed(count_of(i));
+    uint64_t                  first = allocation.index;
+    uint64_t                  current;
+    while ((current = committed.load(std::memory_order_acquire)) != first) {
+      if (current > first)
+        throw std::logic_error("Allocation is already committed");
+      std::this_thread::yield();
+    }
+    committed.store(first + allocation.objects.size(),
+                    std::memory_order_release);
+  }
+
+  // Resizes the spans to include objects committed since attaching. Not
+  // safe while other threads use this attachment's Header.
+  void refresh() { m_header = load(); }
+
+private:
+  // load_header() with the counts read atomically, as other processes may
+  // be committing
+  header_type load() const {
+    constexpr size_t prefixSize =
+        sizeof(file_header) + sizeof(file_section) * sizeof...(ObjectsPtrs);
+    auto bytes = m_segment.bytes();
+    if (bytes.size() < prefixSize)
+      throw std::runtime_error("Shared segment too small for header");
+    std::array<std::byte, prefixSize> prefix;
+    std::memcpy(prefix.data(), bytes.data(), sizeof(file_header));
+    for (size_t i = 0; i < sizeof...(ObjectsPtrs); ++i) {
+      file_section section = read_section(i);
+      std::memcpy(prefix.data() + sizeof(file_header) +
+                      sizeof(file_section) * i,
+                  &section, sizeof(section));
+    }
+    auto layout = read_layout<ObjectsPtrs...>(prefix, bytes.size());
+    if (shared_memory_detail::segment_size(layout.header.file_size,
+                                           sizeof...(ObjectsPtrs)) >
+        bytes.size())
+      throw std::runtime_error("Shared segment has no reserved counts");
+    return load_header<ObjectsPtrs...>(bytes, layout);
+  }
+  // Everything but the count is fixed when the segment is made
+  file_section read_section(size_t i) const {
+    file_section section;
+    const std::byte* address = section_address(i);
+    std::memcpy(&section.offset, address + offsetof(file_section, offset),
+                sizeof(section.offset));
+    std::memcpy(&section.element_size,
+                address + offsetof(file_section, element_size),
+                sizeof(section.element_size));
+    std::memcpy(&section.element_alignment,
+                address + offsetof(file_section, element_alignment),
+                sizeof(section.element_alignment));
+    section.count = std::atomic_ref<uint64_t>(count_of(i)).load(
+        std::memory_order_acquire);
+    return section;
+  }
+  uint64_t file_size() const {
+    uint64_t size;
+    std::memcpy(&size,
+                m_segment.bytes().data() + offsetof(file_header, file_size),
+                sizeof(size));
+    return size;
+  }
+  std::byte* section_address(size_t i) const {
+    return m_segment.bytes().data() + sizeof(file_header) +
+           sizeof(file_section) * i;
+  }
+  uint64_t& count_of(size_t i) const {
+    return *std::launder(reinterpret_cast<uint64_t*>(
+        section_address(i) + offsetof(file_section, count)));
+  }
+  uint64_t& reserved_of(size_t i) const {
+    return *std::launder(reinterpret_cast<uint64_t*>(
+        m_segment.bytes().data() +
+        shared_memory_detail::reserved_offset(file_size()) +
+        sizeof(uint64_t) * i));
+  }
+
+  shared_segment m_segment;
+  header_type    m_header;
+};
+
+} // namespace nodecode
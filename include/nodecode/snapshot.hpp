@@ -0,0 +1,166 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <nodecode/index_ptr.hpp>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace nodecode {
+
+template <class Header, size_t MaxReaders>
+class versioned_header;
+
+// A pinned, read only version of a header. The version stays alive until the
+// snapshot is destroyed, however many newer versions are published. Bind it
+// with bound_header or index_ptr::bind() like any other header, e.g. through
+// index_ptrs with ConstHeader = true.
+template <class Header>
+class header_snapshot {
+public:
+  using header_type = Header;
+  header_snapshot(header_snapshot&& other) noexcept
+      : m_slot(std::exchange(other.m_slot, nullptr)),
+        m_header(other.m_header) {}
+  header_snapshot& operator=(header_snapshot&& other) noexcept {
+    release();
+    m_slot   = std::exchange(other.m_slot, nullptr);
+    m_header = other.m_header;
+    return *this;
+  }
+  ~header_snapshot() { release(); }
+  const header_type& operator*() const { return *m_header; }
+  const header_type* operator->() const { return m_header; }
+  const header_type& get() const { return *m_header; }
+
+private:
+  template <class, size_t>
+  friend class versioned_header;
+  header_snapshot(std::atomic<uint64_t>* slot, const header_type* header)
+      : m_slot(slot), m_header(header) {}
+  void release() {
+    if (m_slot)
+      m_slot->store(0, std::memory_order_release);
+    m_slot = nullptr;
+  }
+  std::atomic<uint64_t>* m_slot;
+  const header_type*     m_header;
+};
+
+// Holds the current version of a Header. Readers pin() a version without
+// locks and never block the writer. Writers build the next version from a
+// copy of the current one, cheap when its arrays are cow_arrays, and
+// publish() it atomically. Replaced versions are freed by epoch based
+// reclamation once no snapshot could still be reading them. At most
+// MaxReaders snapshots may be held at once; pin() waits for a free slot
+// beyond that.
+template <class Header, size_t MaxReaders = 64>
+class versioned_header {
+public:
+  using header_type = Header;
+  using snapshot    = header_snapshot<Header>;
+
+  explicit versioned_header(header_type initial = header_type())
+      : m_current(new header_type(std::move(initial))) {}
+  versioned_header(const versioned_header& other) = delete;
+  versioned_header& operator=(const versioned_header& other) = delete;
+  // Snapshots must not outlive the versioned_header
+  ~versioned_header() { delete m_current.load(); }
+
+  snapshot pin() const {
+    size_t start =
+        std::hash<std::thread::id>()(std::this_thread::get_id()) % MaxReaders;
+    for (;;) {
+      for (size_t i = 0; i < MaxReaders; ++i) {
+        auto&    slot     = m_slots[(start + i) % MaxReaders].epoch;
+        uint64_t expected = 0;
+        // A slot holds the epoch its reader started in. The writer only
+        // frees versions retired after every held epoch.
+        if (slot.load(std::memory_order_relaxed) == 0 &&
+            slot.compare_exchange_strong(expected, m_epoch.load()))
+          return snapshot(&slot, m_current.load());
+      }
+      std::this_thread::yield();
+    }
+  }
+
+  // A copy of the current version to modify and publish()
+  header_type draft() const {
+    std::lock_guard lock(m_writerMutex);
+    return *m_current.load();
+  }
+
+  // Makes next the current version. Snapshots pinned before this keep
+  // reading the previous version.
+  void publish(header_type next) {
+    auto            fresh = std::make_unique<header_type>(std::move(next));
+    std::lock_guard lock(m_writerMutex);
+    publish_locked(std::move(fresh));
+  }
+
+  // Copies the current version, calls fn(Header&) on the copy and publishes
+  // it. Concurrent updates are applied one after the other.
+  template <class Fn>
+  void update(Fn&& fn) {
+    std::lock_guard lock(m_writerMutex);
+    auto            next = std::make_unique<header_type>(*m_current.load());
+    std::invoke(fn, *next);
+    publish_locked(std::move(next));
+  }
+
+  // Frees replaced versions no snapshot can still be reading. Called by
+  // publish() and update(); only needed after the last publish.
+  void reclaim() {
+    std::lock_guard lock(m_writerMutex);
+    reclaim_locked();
+  }
+
+  // Replaced versions not yet freed
+  size_t retired() const {
+    std::lock_guard lock(m_writerMutex);
+    return m_retired.size();
+  }
+
+private:
+  struct alignas(64) reader_slot {
+    std::atomic<uint64_t> epoch = 0;
+  };
+  struct retired_version {
+    std::unique_ptr<header_type> header;
+    uint64_t                     epoch;
+  };
+
+  void publish_locked(std::unique_ptr<header_type> next) {
+    std::unique_ptr<header_type> old(m_current.exchange(next.release()));
+    // Readers that start in this epoch or later load the new version
+    uint64_t epoch = m_epoch.fetch_add(1) + 1;
+    m_retired.push_back({std::move(old), epoch});
+    reclaim_locked();
+  }
+
+  void reclaim_locked() {
+    uint64_t oldest = std::numeric_limits<uint64_t>::max();
+    for (auto& slot : m_slots)
+      if (uint64_t epoch = slot.epoch.load())
+        oldest = std::min(oldest, epoch);
+    std::erase_if(m_retired, [oldest](const retired_version& version) {
+      return version.epoch <= oldest;
+    });
+  }
+
+  std::atomic<header_type*>                m_current;
+  std::atomic<uint64_t>                    m_epoch = 1;
+  mutable std::array<reader_slot, MaxReaders> m_slots;
+  mutable std::mutex                       m_writerMutex;
+  std::vector<retired_version>             m_retired;
+};
+
+} // namespace nodecode
@@ -0,0 +1,217 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#pragma once
+
+#include <compare>
+#include <cstddef>
+#include <iterator>
+#include <nodecode/index_ptr.hpp>
+#include <ranges>
+#include <span>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace nodecode {
+
+// Struct of arrays support: one index into several parallel column arrays of
+// the same Header, e.g. positions, velocities and ids. Dereferencing gives a
+// soa_reference to the element in every column. Columns are expected to have
+// the same size.
+
+template <auto ObjectsPtr>
+using column_value_t = typename index_ptr<ObjectsPtr>::value_type;
+
+// References to one element of each column. Works with structured bindings:
+// auto [position, velocity] = *ptr;
+template <auto... ObjectsPtrs>
+class soa_reference {
+public:
+  using header_type = objects_header_t<ObjectsPtrs...>;
+  using tuple_type  = std::tuple<column_value_t<ObjectsPtrs>&...>;
+  constexpr soa_reference(column_value_t<ObjectsPtrs>&... columns)
+      : m_columns(columns...) {}
+
+  template <auto ObjectsPtr>
+  constexpr auto& column() const {
+    constexpr size_t i = objects_index<ObjectsPtr, ObjectsPtrs...>();
+    static_assert(i < sizeof...(ObjectsPtrs), "ObjectsPtr not in soa_reference");
+    return std::get<i>(m_columns);
+  }
+  // By position, for structured bindings
+  template <size_t I>
+  constexpr auto& get() const {
+    return std::get<I>(m_columns);
+  }
+  constexpr const tuple_type& tuple() const { return m_columns; }
+
+  // Assigns every column from a tuple of values
+  template <class... Values>
+    requires(sizeof...(Values) == sizeof...(ObjectsPtrs))
+  const soa_reference& operator=(const std::tuple<Values...>& values) const {
+    [&]<size_t... I>(std::index_sequence<I...>) {
+      ((std::get<I>(m_columns) = std::get<I>(values)), ...);
+    }(std::index_sequence_for<Values...>());
+    return *this;
+  }
+
+private:
+  tuple_type m_columns;
+};
+
+// index_ptr to the same element of several column arrays
+template <class IndexType, auto... ObjectsPtrs>
+class basic_soa_index_ptr {
+public:
+  using header_type = objects_header_t<ObjectsPtrs...>;
+  using reference   = soa_reference<ObjectsPtrs...>;
+  using index_type  = IndexType;
+  constexpr basic_soa_index_ptr() = default;
+  constexpr basic_soa_index_ptr(const index_type& index) : m_index(index) {}
+  constexpr reference bind(header_type& header) const {
+    return reference(*index_ptr<ObjectsPtrs, IndexType>(m_index).bind(header)...);
+  }
+  reference get() const { return bind(*bound_header<header_type>::get()); }
+  reference operator*() const { return get(); }
+  reference operator[](index_type pos) const {
+    return basic_soa_index_ptr(index_type(m_index + pos)).get();
+  }
+  // The column index_ptr for one column
+  template <auto ObjectsPtr>
+  constexpr index_ptr<ObjectsPtr, IndexType> column() const {
+    static_assert(objects_index<ObjectsPtr, ObjectsPtrs...>() <
+                      sizeof...(ObjectsPtrs),
+                  "ObjectsPtr not in soa_index_ptr");
+    return m_index;
+  }
+  constexpr operator index_type&() { return m_index; }
+  constexpr operator const index_type&() const { return m_index; }
+
+private:
+  index_type m_index = 0;
+};
+
+template <auto... ObjectsPtrs>
+using soa_index_ptr = basic_soa_index_ptr<uint32_t, ObjectsPtrs...>;
+
+// A bound soa_index_span: one std::span per column plus iteration over
+// soa_references
+template <auto... ObjectsPtrs>
+class soa_span {
+public:
+  using reference = soa_reference<ObjectsPtrs...>;
+
+  class iterator {
+  public:
+    using iterator_concept = std::random_access_iterator_tag;
+    using value_type       = reference;
+    using difference_type  = std::ptrdiff_t;
+    iterator()             = default;
+    iterator(const soa_span* span, size_t index) : m_span(span), m_index(index) {}
+    reference operator*() const { return (*m_span)[m_index]; }
+    reference operator[](difference_type n) const { return *(*this + n); }
+    iterator& operator++() {
+      ++m_index;
+      return *this;
+    }
+    iterator& operator--() {
+      --m_index;
+      return *this;
+    }
+    iterator operator++(int) { return {m_span, m_index++}; }
+    iterator operator--(int) { return {m_span, m_index--}; }
+    iterator& operator+=(difference_type n) {
+      m_index = size_t(difference_type(m_index) + n);
+      return *this;
+    }
+    iterator& operator-=(difference_type n) { return *this += -n; }
+    friend iterator operator+(iterator it, difference_type n) { return it += n; }
+    friend iterator operator+(difference_type n, iterator it) { return it += n; }
+    friend iterator operator-(iterator it, difference_type n) { return it -= n; }
+    friend difference_type operator-(const iterator& a, const iterator& b) {
+      return difference_type(a.m_index) - difference_type(b.m_index);
+    }
+    bool operator==(const iterator& other) const {
+      return m_index == other.m_index;
+    }
+    auto operator<=>(const iterator& other) const {
+      return m_index <=> other.m_index;
+    }
+
+  private:
+    const soa_span* m_span  = nullptr;
+    size_t          m_index = 0;
+  };
+
+  constexpr soa_span(std::span<column_value_t<ObjectsPtrs>>... columns)
+      : m_columns(columns...) {}
+  constexpr size_t size() const { return std::get<0>(m_columns).size(); }
+  constexpr bool   empty() const { return size() == 0; }
+
+  // One column as a plain span, e.g. for a vectorized kernel
+  template <auto ObjectsPtr>
+  constexpr auto column() const {
+    constexpr size_t i = objects_index<ObjectsPtr, ObjectsPtrs...>();
+    static_assert(i < sizeof...(ObjectsPtrs), "ObjectsPtr not in soa_span");
+    return std::get<i>(m_columns);
+  }
+  constexpr const auto& columns() const { return m_columns; }
+  constexpr reference   operator[](size_t index) const {
+    return std::apply(
+        [index](auto&... columns) { return reference(columns[index]...); },
+        m_columns);
+  }
+  iterator begin() const { return {this, 0}; }
+  iterator end() const { return {this, size()}; }
+
+private:
+  std::tuple<std::span<column_value_t<ObjectsPtrs>>...> m_columns;
+};
+
+// index_span over several column arrays
+template <class IndexType, class SizeType, auto... ObjectsPtrs>
+class basic_soa_index_span {
+public:
+  using header_type = objects_header_t<ObjectsPtrs...>;
+  using index_type  = IndexType;
+  using size_type   = SizeType;
+  constexpr basic_soa_index_span() = default;
+  constexpr basic_soa_index_span(const index_type& index, const size_type& size)
+      : m_index(index), m_size(size) {}
+  constexpr const index_type& index() const { return m_index; }
+  constexpr const size_type&  size() const { return m_size; }
+  constexpr soa_span<ObjectsPtrs...> bind(header_type& header) const {
+    return soa_span<ObjectsPtrs...>(std::span<column_value_t<ObjectsPtrs>>(
+        std::ranges::data(header.*ObjectsPtrs) + m_index, m_size)...);
+  }
+  soa_span<ObjectsPtrs...> span() const {
+    return bind(*bound_header<header_type>::get());
+  }
+  // The index_span for one column
+  template <auto ObjectsPtr>
+  constexpr index_span<ObjectsPtr, IndexType, false, SizeType> column() const {
+    static_assert(objects_index<ObjectsPtr, ObjectsPtrs...>() <
+                      sizeof...(ObjectsPtrs),
+                  "ObjectsPtr not in soa_index_span");
+    return {m_index, m_size};
+  }
+
+private:
+  index_type m_index = 0;
+  size_type  m_size  = 0;
+};
+
+template <auto... ObjectsPtrs>
+using soa_index_span = basic_soa_index_span<uint32_t, uint32_t, ObjectsPtrs...>;
+
+} // namespace nodecode
+
+template <auto... ObjectsPtrs>
+struct std::tuple_size<nodecode::soa_reference<ObjectsPtrs...>>
+    : std::integral_constant<size_t, sizeof...(ObjectsPtrs)> {};
+
+template <size_t I, auto... ObjectsPtrs>
+struct std::tuple_element<I, nodecode::soa_reference<ObjectsPtrs...>> {
+  using type = std::tuple_element_t<
+      I, typename nodecode::soa_reference<ObjectsPtrs...>::tuple_type>;
+};
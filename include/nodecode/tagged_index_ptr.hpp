@@ -0,0 +1,234 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#pragma once
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <nodecode/index_ptr.hpp>
+#include <ranges>
+#include <span>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace nodecode {
+
+template <class IndexType, auto... ObjectsPtrs>
+class tagged_buckets;
+
+// An index into one of several arrays of the same Header, e.g. "a Foo or a
+// Bar", in a single IndexType. The top bits hold a tag, the position of the
+// target array in ObjectsPtrs, and the rest the index. With two arrays and
+// the default uint32_t, that is 31 bits of index in 4 bytes, where a
+// std::variant of index_ptrs takes 8.
+template <class IndexType, auto... ObjectsPtrs>
+class basic_tagged_index_ptr {
+public:
+  using header_type  = objects_header_t<ObjectsPtrs...>;
+  using index_type   = IndexType;
+  using buckets_type = tagged_buckets<IndexType, ObjectsPtrs...>;
+  static_assert(std::is_unsigned_v<IndexType>);
+  static_assert(sizeof...(ObjectsPtrs) >= 2, "Use index_ptr for one array");
+
+  static constexpr size_t   tag_count = sizeof...(ObjectsPtrs);
+  static constexpr unsigned tag_bits =
+      unsigned(std::bit_width(tag_count - 1));
+  static constexpr unsigned index_bits = 8 * sizeof(IndexType) - tag_bits;
+  static constexpr index_type max_index =
+      index_type(~index_type(0) >> tag_bits);
+
+  template <auto ObjectsPtr>
+  static constexpr size_t tag_of = objects_index<ObjectsPtr, ObjectsPtrs...>();
+
+  template <size_t Tag>
+  using pointer_type = index_ptr<
+      std::get<Tag>(std::tuple(ObjectsPtrs...)), IndexType>;
+
+  constexpr basic_tagged_index_ptr() = default;
+  // Implicit, like storing an alternative in a std::variant. Throws if the
+  // index needs the tag bits.
+  template <auto ObjectsPtr, class OtherIndex>
+  constexpr basic_tagged_index_ptr(const index_ptr<ObjectsPtr, OtherIndex>& ptr)
+      : basic_tagged_index_ptr(
+            tag_of<ObjectsPtr>,
+            size_t(static_cast<const OtherIndex&>(ptr))) {
+    static_assert(tag_of<ObjectsPtr> < tag_count,
+                  "ObjectsPtr not in tagged_index_ptr");
+  }
+  constexpr basic_tagged_index_ptr(size_t tag, size_t index) {
+    if (tag >= tag_count || index > max_index)
+      throw std::out_of_range("Index does not fit tagged_index_ptr");
+    m_word = index_type(index_type(tag) << index_bits | index);
+  }
+
+  constexpr size_t     tag() const { return size_t(m_word >> index_bits); }
+  constexpr index_type index() const { return index_type(m_word & max_index); }
+  constexpr const index_type& word() const { return m_word; }
+
+  // Whether the tag names one of ObjectsPtrs. The constructors guarantee
+  // it, but a word read from a file may hold any tag that fits tag_bits.
+  constexpr bool valid() const {
+    return tag_count == size_t(1) << tag_bits || tag() < tag_count;
+  }
+  // tag(), throwing std::out_of_range if it names no array
+  constexpr size_t checked_tag() const {
+    if (!valid())
+      throw std::out_of_range("tagged_index_ptr tag out of range");
+    return tag();
+  }
+
+  template <auto ObjectsPtr>
+  constexpr bool holds() const {
+    return tag() == tag_of<ObjectsPtr>;
+  }
+  // The index_ptr for ObjectsPtr. Throws std::bad_variant_access if the
+  // tag is for another array.
+  template <auto ObjectsPtr>
+  constexpr pointer_type<tag_of<ObjectsPtr>> as() const {
+    if (!holds<ObjectsPtr>())
+      throw std::bad_variant_access();
+    return index();
+  }
+
+  // Calls fn with a reference to the target object. Dispatch is a chain of
+  // tag compares the compiler turns into a jump table, with each case
+  // inlined; no heap or vtable. Every alternative must give fn the same
+  // return type. Throws std::out_of_range for a tag that names no array.
+  template <class Fn>
+  decltype(auto) visit(header_type& header, Fn&& fn) const {
+    checked_tag();
+    return visit_from<0>(header, fn);
+  }
+  template <class Fn>
+  decltype(auto) visit(Fn&& fn) const {
+    return visit(*bound_header<header_type>::get(), std::forward<Fn>(fn));
+  }
+
+  constexpr bool operator==(const basic_tagged_index_ptr& other) const {
+    return m_word == other.m_word;
+  }
+
+private:
+  template <size_t Tag, class Fn>
+  decltype(auto) visit_from(header_type& header, Fn& fn) const {
+    if constexpr (Tag + 1 == tag_count) {
+      return fn(*pointer_type<Tag>(index()).bind(header));
+    } else {
+      using result = decltype(fn(*pointer_type<Tag>(index()).bind(header)));
+      static_assert(
+          std::is_same_v<result, decltype(visit_from<Tag + 1>(header, fn))>,
+          "visit() needs the same return type for every array");
+      if (tag() == Tag)
+        return fn(*pointer_type<Tag>(index()).bind(header));
+      return visit_from<Tag + 1>(header, fn);
+    }
+  }
+
+  index_type m_word = 0;
+};
+
+template <auto... ObjectsPtrs>
+using tagged_index_ptr = basic_tagged_index_ptr<uint32_t, ObjectsPtrs...>;
+
+// A range of tagged_index_ptr split by tag, keeping the original order
+// within each tag. Each bucket is a plain array of index_ptr, so work on it
+// needs no dispatch, e.g. gather() or prefetch_view. positions() maps each
+// bucketed element back to its place in the original range. Throws
+// std::out_of_range, before bucketing anything, for a tag that names no
+// array.
+template <class IndexType, auto... ObjectsPtrs>
+class tagged_buckets {
+public:
+  using tagged_type = basic_tagged_index_ptr<IndexType, ObjectsPtrs...>;
+
+  template <std::ranges::forward_range Range>
+  explicit tagged_buckets(const Range& ptrs) {
+    std::array<size_t, tagged_type::tag_count> counts{};
+    for (const tagged_type& ptr : ptrs)
+      ++counts[ptr.checked_tag()];
+    [&]<size_t... Tags>(std::index_sequence<Tags...>) {
+      (std::get<Tags>(m_buckets).reserve(counts[Tags]), ...);
+    }(std::make_index_sequence<tagged_type::tag_count>());
+    for (size_t tag = 0; tag < tagged_type::tag_count; ++tag)
+      m_positions[tag].reserve(counts[tag]);
+    size_t position = 0;
+    for (const tagged_type& ptr : ptrs) {
+      push(ptr, std::make_index_sequence<tagged_type::tag_count>());
+      m_positions[ptr.tag()].push_back(position++);
+    }
+  }
+
+  template <auto ObjectsPtr>
+  std::span<const index_ptr<ObjectsPtr, IndexType>> bucket() const {
+    return std::get<tagged_type::template tag_of<ObjectsPtr>>(m_buckets);
+  }
+  template <auto ObjectsPtr>
+  std::span<const size_t> positions() const {
+    return m_positions[tagged_type::template tag_of<ObjectsPtr>];
+  }
+
+  // Calls fn(object) for every target, bucket by bucket
+  template <class Fn>
+  void for_each(typename tagged_type::header_type& header, Fn&& fn) const {
+    (
+        [&] {
+          for (const auto& ptr : bucket<ObjectsPtrs>())
+            fn(*ptr.bind(header));
+        }(),
+        ...);
+  }
+
+private:
+  template <size_t... Tags>
+  void push(const tagged_type& ptr, std::index_sequence<Tags...>) {
+    ((ptr.tag() == Tags ? std::get<Tags>(m_buckets).push_back(ptr.index())
+                        : void()),
+     ...);
+  }
+
+  std::tuple<std::vector<index_ptr<ObjectsPtrs, IndexType>>...> m_buckets;
+  std::array<std::vector<size_t>, sizeof...(ObjectsPtrs)>       m_positions;
+};
+
+// Splits a range of tagged_index_ptr by tag
+template <std::ranges::forward_range Range>
+auto bucket_by_tag(const Range& ptrs) {
+  return typename std::ranges::range_value_t<Range>::buckets_type(ptrs);
+}
+
+// Calls fn(object) for the target of every tagged_index_ptr in ptrs, one
+// array at a time, so each pass is a tight loop over one type. Targets in
+// the same array are visited in their order in ptrs. Unlike bucket_by_tag()
+// this keeps no positions, just the indices in one buffer. Throws
+// std::out_of_range, before calling fn, for a tag that names no array.
+template <std::ranges::forward_range Range, class Fn>
+void for_each_by_tag(
+    const Range&                                             ptrs,
+    typename std::ranges::range_value_t<Range>::header_type& header, Fn&& fn) {
+  using tagged_type = std::ranges::range_value_t<Range>;
+  using index_type  = typename tagged_type::index_type;
+  std::array<size_t, tagged_type::tag_count + 1> offsets{};
+  for (const tagged_type& ptr : ptrs)
+    ++offsets[ptr.checked_tag() + 1];
+  for (size_t tag = 1; tag <= tagged_type::tag_count; ++tag)
+    offsets[tag] += offsets[tag - 1];
+  std::vector<index_type> indices(offsets.back());
+  auto                    cursor = offsets;
+  for (const tagged_type& ptr : ptrs)
+    indices[cursor[ptr.tag()]++] = ptr.index();
+  [&]<size_t... Tags>(std::index_sequence<Tags...>) {
+    (
+        [&] {
+          for (size_t i = offsets[Tags]; i < offsets[Tags + 1]; ++i)
+            fn(*typename tagged_type::template pointer_type<Tags>(indices[i])
+                    .bind(header));
+        }(),
+        ...);
+  }(std::make_index_sequence<tagged_type::tag_count>());
+}
+
+} // namespace nodecode
@@ -0,0 +1,134 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#pragma once
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstddef>
+#include <nodecode/index_ptr.hpp>
+#include <nodecode/parallel.hpp>
+#include <ranges>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace nodecode {
+
+template <class Header>
+class validated_header;
+
+namespace validate_detail {
+
+// Whether ref is within an array of count objects. Compares without adding,
+// so indices near the top of a 64 bit IndexType cannot wrap around.
+template <class Ref>
+bool in_range(const Ref& ref, uint64_t count) {
+  using index_type = typename Ref::index_type;
+  if constexpr (is_index_ptr_v<Ref>) {
+    return uint64_t(static_cast<const index_type&>(ref)) < count;
+  } else {
+    uint64_t index = uint64_t(ref.index()), size = uint64_t(ref.size());
+    // Branch free; count - index is only used when index <= count
+    return (index <= count) & (size <= count - index);
+  }
+}
+
+template <class Ref>
+std::string describe(const Ref& ref) {
+  using index_type = typename Ref::index_type;
+  if constexpr (is_index_ptr_v<Ref>)
+    return "index_ptr " +
+           std::to_string(uint64_t(static_cast<const index_type&>(ref)));
+  else
+    return "index_span " + std::to_string(uint64_t(ref.index())) + "+" +
+           std::to_string(uint64_t(ref.size()));
+}
+
+// validate() is the only way to make a validated_header
+struct access {
+  template <class Header>
+  static validated_header<Header> make(Header& header) {
+    return validated_header<Header>(header);
+  }
+};
+
+// Throws unless every reference named by refs is within its target array.
+// Each chunk is a branch free reduction the compiler can vectorize.
+template <class Header, auto ArrayPtr, auto... MemberPtr>
+void check(Header& header, index_refs<ArrayPtr, MemberPtr...>,
+           size_t chunkSize, size_t threadCount) {
+  auto& array   = header.*ArrayPtr;
+  using element = std::remove_reference_t<
+      std::ranges::range_reference_t<decltype(array)>>;
+  using ref_type = std::remove_cvref_t<decltype(ref_of<MemberPtr...>(
+      std::declval<const element&>()))>;
+  static_assert(is_index_ptr_v<ref_type> || is_index_span_v<ref_type>,
+                "index_refs must name index_ptr or index_span objects");
+  auto     first  = std::ranges::begin(array);
+  size_t   size   = std::ranges::size(array);
+  size_t   chunks = (size + chunkSize - 1) / chunkSize;
+  uint64_t limit  = std::ranges::size(header.*ref_type::objects_ptr);
+  std::vector<char> bad(chunks);
+  parallel_for_each(
+      header, std::views::iota(size_t(0), chunks),
+      [&](size_t chunk) {
+        size_t begin = chunk * chunkSize;
+        size_t end   = std::min(begin + chunkSize, size);
+        bool   any   = false;
+        for (size_t i = begin; i < end; ++i)
+          any |= !in_range(ref_of<MemberPtr...>(first[i]), limit);
+        bad[chunk] = any;
+      },
+      1, threadCount);
+  for (size_t chunk = 0; chunk < chunks; ++chunk) {
+    if (!bad[chunk])
+      continue;
+    // Rare, so find the exact element serially
+    for (size_t i = chunk * chunkSize; i < size; ++i) {
+      const auto& ref = ref_of<MemberPtr...>(first[i]);
+      if (!in_range(ref, limit))
+        throw std::out_of_range(describe(ref) + " at element " +
+                                std::to_string(i) + " is past array size " +
+                                std::to_string(limit));
+    }
+  }
+}
+
+} // namespace validate_detail
+
+// A Header whose listed references were all checked to be in range by
+// validate(). Derefs through it, including bound_view and gather(), need no
+// further bounds checks as long as the arrays and references are not
+// modified.
+template <class Header>
+class validated_header {
+public:
+  using header_type = Header;
+  header_type&       operator*() { return *m_header; }
+  const header_type& operator*() const { return *m_header; }
+  header_type*       operator->() { return m_header; }
+  const header_type* operator->() const { return m_header; }
+  header_type&       get() { return *m_header; }
+  const header_type& get() const { return *m_header; }
+
+private:
+  friend struct validate_detail::access;
+  explicit validated_header(header_type& header) : m_header(&header) {}
+  header_type* m_header;
+};
+
+// Checks once, e.g. after mapping a file or attaching shared memory, that
+// every reference named by Refs is within its target array. Each Refs is an
+// index_refs<>. Throws std::out_of_range naming the first bad element.
+template <class... Refs, class Header>
+validated_header<Header>
+validate(Header& header, size_t chunkSize = default_parallel_chunk * 16,
+         size_t threadCount = std::thread::hardware_concurrency()) {
+  chunkSize = std::max(chunkSize, size_t(1));
+  (validate_detail::check(header, Refs{}, chunkSize, threadCount), ...);
+  return validate_detail::access::make(header);
+}
+
+} // namespace nodecode
@@ -0,0 +1,174 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <gtest/gtest.h>
+#include <memory>
+#include <nodecode/address_map.hpp>
+#include <nodecode/index_ptr.hpp>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+using namespace nodecode;
+
+namespace address_map_test {
+
+// A pointer based graph, as it might come from an existing codebase
+struct Node {
+  int                value = 0;
+  Node*              next  = nullptr;
+  std::vector<Node*> children;
+};
+
+struct Foo;
+
+struct Header {
+  std::vector<Foo>                      foos;
+  std::vector<index_ptr<&Header::foos>> children;
+};
+
+struct Foo {
+  int                           value = 0;
+  index_ptr<&Header::foos>      next;
+  bool                          hasNext  = false;
+  index_span<&Header::children> children = {};
+};
+
+} // namespace address_map_test
+
+using namespace address_map_test;
+
+TEST(AddressMap, Find) {
+  std::deque<int> objects(1000);
+  address_map<int> map(objects, 7, 3);
+  EXPECT_EQ(map.size(), objects.size());
+  for (size_t i = 0; i < objects.size(); ++i)
+    EXPECT_EQ(map.find(&objects[i]), i);
+  int other = 0;
+  EXPECT_EQ(map.find(&other), address_map<int>::npos);
+  EXPECT_EQ(map.find(nullptr), address_map<int>::npos);
+
+  address_map<int> empty(std::vector<int>{});
+  EXPECT_EQ(empty.find(&other), address_map<int>::npos);
+  EXPECT_THROW((void)empty.to_index_ptr<&Header::foos>(&other),
+               std::out_of_range);
+}
+
+TEST(AddressMap, Pointers) {
+  // Separate allocations in shuffled order
+  std::vector<std::unique_ptr<int>> owned;
+  for (int i = 0; i < 5000; ++i)
+    owned.push_back(std::make_unique<int>(i));
+  std::ranges::shuffle(owned, std::mt19937(1));
+  address_map<int> map(owned, 64, 4);
+  for (size_t i = 0; i < owned.size(); ++i)
+    EXPECT_EQ(map.find(owned[i].get()), i);
+
+  std::vector<int*> raw;
+  for (auto& p : owned)
+    raw.push_back(p.get());
+  raw.push_back(raw[10]);
+  EXPECT_THROW(address_map<int>(raw, 64, 4), std::invalid_argument);
+
+  // Null has no object and would otherwise fill an empty slot
+  raw.back() = nullptr;
+  EXPECT_THROW(address_map<int>(raw, 64, 4), std::invalid_argument);
+  owned[20].reset();
+  EXPECT_THROW(address_map<int>(owned, 64, 4), std::invalid_argument);
+}
+
+TEST(AddressMap, Spans) {
+  std::vector<int> a(10), b(10);
+  std::vector<int*> objects;
+  for (auto& x : a)
+    objects.push_back(&x);
+  for (auto& x : b)
+    objects.push_back(&x);
+  address_map<int> map(objects);
+  auto span = map.to_index_span<&Header::foos, uint32_t, uint8_t>(&b[2], 5);
+  EXPECT_EQ(span.index(), 12);
+  EXPECT_EQ(span.size(), 5);
+  EXPECT_EQ(map.to_index_span<&Header::foos>(&a[0], 0).size(), 0);
+  EXPECT_EQ(map.to_index_span<&Header::foos>(&b[2], 8).size(), 8);
+  // Checked before any pointer past the end of b is formed
+  EXPECT_THROW((void)map.to_index_span<&Header::foos>(&b[2], 9),
+               std::out_of_range);
+
+  std::reverse(objects.begin() + 10, objects.end());
+  address_map<int> reversed(objects);
+  EXPECT_THROW((void)reversed.to_index_span<&Header::foos>(&b[7], 3),
+               std::invalid_argument);
+  EXPECT_THROW((void)reversed.to_index_span<&Header::foos>(&b[2], 5),
+               std::out_of_range);
+  int stray = 0;
+  EXPECT_THROW((void)reversed.to_index_ptr<&Header::foos>(&stray),
+               std::out_of_range);
+}
+
+TEST(AddressMap, ConvertGraph) {
+  // A ring of nodes, each with the next three as children
+  const int                          count = 3000;
+  std::vector<std::unique_ptr<Node>> nodes;
+  for (int i = 0; i < count; ++i)
+    nodes.push_back(std::make_unique<Node>(Node{i, nullptr, {}}));
+  for (int i = 0; i < count; ++i) {
+    if (i % 7)
+      nodes[i]->next = nodes[(i + 1) % count].get();
+    for (int c = 1; c <= 3; ++c)
+      nodes[i]->children.push_back(nodes[(i + c) % count].get());
+  }
+  std::ranges::shuffle(nodes, std::mt19937(2));
+
+  address_map<Node> map(nodes, 100, 4);
+  Header            header;
+  // Child lists are only appended once the objects are converted, so sized
+  // up front
+  std::vector<size_t> childBegin(nodes.size() + 1);
+  for (size_t i = 0; i < nodes.size(); ++i)
+    childBegin[i + 1] = childBegin[i] + nodes[i]->children.size();
+  header.children.resize(childBegin.back());
+  convert_objects<&Header::foos>(
+      header, nodes,
+      [&](const Node& node) {
+        Foo foo{node.value, {}, node.next != nullptr, {}};
+        if (node.next)
+          foo.next = map.to_index_ptr<&Header::foos>(node.next);
+        size_t first = childBegin[size_t(map.find(&node))];
+        for (size_t c = 0; c < node.children.size(); ++c)
+          header.children[first + c] =
+              map.to_index_ptr<&Header::foos>(node.children[c]);
+        foo.children = {uint32_t(first), uint32_t(node.children.size())};
+        return foo;
+      },
+      100, 4);
+
+  ASSERT_EQ(header.foos.size(), size_t(count));
+  bound_header bound(header);
+  for (size_t i = 0; i < nodes.size(); ++i) {
+    const Foo& foo = header.foos[i];
+    EXPECT_EQ(foo.value, nodes[i]->value);
+    EXPECT_EQ(foo.hasNext, foo.value % 7 != 0);
+    if (foo.hasNext) {
+      EXPECT_EQ(foo.next->value, (foo.value + 1) % count);
+    }
+    ASSERT_EQ(foo.children.size(), 3);
+    for (int c = 0; c < 3; ++c)
+      EXPECT_EQ(foo.children[c]->value, (foo.value + c + 1) % count);
+  }
+
+  // Pointers outside the graph surface as exceptions from the workers
+  Node stray;
+  nodes[5]->next = &stray;
+  EXPECT_THROW(convert_objects<&Header::foos>(
+                   header, nodes,
+                   [&](const Node& node) {
+                     Foo foo{node.value, {}, false, {}};
+                     if (node.next)
+                       foo.next = map.to_index_ptr<&Header::foos>(node.next);
+                     return foo;
+                   },
+                   100, 4),
+               std::out_of_range);
+}
@@ -0,0 +1,159 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#include <cstdint>
+#include <gtest/gtest.h>
+#include <nodecode/backlinks.hpp>
+#include <nodecode/index_ptr.hpp>
+#include <random>
+#include <ranges>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace nodecode;
+
+namespace backlinks_test {
+
+struct Foo;
+struct Bar;
+
+struct Header {
+  std::vector<Foo>                               foos;
+  std::vector<Bar>                               bars;
+  std::vector<index_ptr<&Header::foos>>          fooBacklinks;
+  std::vector<index_span<&Header::fooBacklinks>> barFoos;
+  std::vector<index_ptr<&Header::bars>>          barBacklinks;
+  std::vector<index_span<&Header::fooBacklinks, uint32_t, false, uint8_t>>
+      narrowBarFoos;
+};
+
+struct Foo {
+  std::string                       data;
+  index_ptr<&Header::bars>          bar;
+  index_span<&Header::barBacklinks> parents = {};
+};
+
+struct Bar {
+  std::string                       data;
+  index_span<&Header::foos>         children = {};
+  index_span<&Header::fooBacklinks> foos     = {};
+};
+
+using FooBars     = index_refs<&Header::foos, &Foo::bar>;
+using BarChildren = index_refs<&Header::bars, &Bar::children>;
+
+} // namespace backlinks_test
+
+using namespace backlinks_test;
+
+TEST(Backlinks, IndexPtr) {
+  Header header;
+  for (uint32_t i = 0; i < 6; ++i)
+    header.foos.push_back({"foo" + std::to_string(i), i % 3 == 1 ? 2u : 0u});
+  header.bars = {{"bar0"}, {"bar1"}, {"bar2"}};
+  build_backlinks<FooBars, &Header::fooBacklinks,
+                  index_refs<&Header::barFoos>>(header, 1, 3);
+  ASSERT_EQ(header.barFoos.size(), 3);
+  ASSERT_EQ(header.fooBacklinks.size(), 6);
+  bound_header bound(header);
+  auto         names = [](auto span) {
+    std::vector<std::string> result;
+    for (auto& foo : span)
+      result.push_back(foo->data);
+    return result;
+  };
+  EXPECT_EQ(names(header.barFoos[0]),
+            (std::vector<std::string>{"foo0", "foo2", "foo3", "foo5"}));
+  EXPECT_EQ(header.barFoos[1].size(), 0);
+  EXPECT_EQ(names(header.barFoos[2]),
+            (std::vector<std::string>{"foo1", "foo4"}));
+
+  // Same, stored in each Bar
+  build_backlinks<FooBars, &Header::fooBacklinks,
+                  index_refs<&Header::bars, &Bar::foos>>(header);
+  EXPECT_EQ(names(header.bars[0].foos), names(header.barFoos[0]));
+  EXPECT_EQ(names(header.bars[2].foos), names(header.barFoos[2]));
+  for (auto& foo : header.bars[2].foos)
+    EXPECT_EQ(foo->bar->data, "bar2");
+}
+
+TEST(Backlinks, IndexSpan) {
+  Header header;
+  header.foos.resize(5);
+  header.bars = {
+      {"bar0", {0, 3}},
+      {"bar1", {2, 2}},
+      {"bar2", {0, 0}},
+  };
+  build_backlinks<BarChildren, &Header::barBacklinks,
+                  index_refs<&Header::foos, &Foo::parents>>(header);
+  bound_header bound(header);
+  auto         parents = [&](size_t foo) {
+    std::vector<std::string> result;
+    for (auto& bar : header.foos[foo].parents)
+      result.push_back(bar->data);
+    return result;
+  };
+  EXPECT_EQ(parents(0), (std::vector<std::string>{"bar0"}));
+  EXPECT_EQ(parents(2), (std::vector<std::string>{"bar0", "bar1"}));
+  EXPECT_EQ(parents(3), (std::vector<std::string>{"bar1"}));
+  EXPECT_EQ(parents(4), (std::vector<std::string>{}));
+}
+
+TEST(Backlinks, OutOfRange) {
+  Header header;
+  header.foos = {{"foo0", 0}, {"foo1", 1}};
+  header.bars = {{"bar0"}};
+  EXPECT_THROW((build_backlinks<FooBars, &Header::fooBacklinks,
+                                index_refs<&Header::barFoos>>(header)),
+               std::out_of_range);
+}
+
+TEST(Backlinks, SizeTypeOverflow) {
+  // Bar 0 and the last bar fall in different blocks. The last bar has more
+  // backlinks than a uint8_t size holds.
+  Header header;
+  header.bars.resize(5000);
+  header.foos = {{"foo0", 0}};
+  for (int i = 0; i < 300; ++i)
+    header.foos.push_back({"foo", 4999});
+  header.fooBacklinks.assign(3, 7);
+  header.narrowBarFoos.assign(5000, {1, 2});
+  auto build = [&] {
+    build_backlinks<FooBars, &Header::fooBacklinks,
+                    index_refs<&Header::narrowBarFoos>>(header, 16, 1);
+  };
+  EXPECT_THROW(build(), std::out_of_range);
+  // Nothing was written before the throw
+  EXPECT_EQ(header.fooBacklinks,
+            (std::vector<index_ptr<&Header::foos>>(3, 7)));
+  for (auto& span : header.narrowBarFoos)
+    ASSERT_EQ(std::pair(span.index(), uint32_t(span.size())),
+              std::pair(1u, 2u));
+}
+
+TEST(Backlinks, MatchesSerial) {
+  constexpr uint32_t fooCount = 200000, barCount = 3000;
+  Header             header;
+  header.bars.resize(barCount);
+  std::mt19937                            rng(7);
+  std::uniform_int_distribution<uint32_t> dist(0, barCount - 1);
+  std::vector<std::vector<uint32_t>>      expected(barCount);
+  for (uint32_t i = 0; i < fooCount; ++i) {
+    // Skewed so a few bars collect most of the references
+    uint32_t bar = dist(rng) % (1 + dist(rng));
+    header.foos.push_back({"", bar});
+    expected[bar].push_back(i);
+  }
+  build_backlinks<FooBars, &Header::fooBacklinks,
+                  index_refs<&Header::barFoos>>(header, 1000, 4);
+  ASSERT_EQ(header.fooBacklinks.size(), fooCount);
+  bound_header bound(header);
+  for (uint32_t bar = 0; bar < barCount; ++bar) {
+    std::vector<uint32_t> got;
+    for (auto& foo : header.barFoos[bar])
+      got.push_back(foo);
+    ASSERT_EQ(got, expected[bar]);
+  }
+}
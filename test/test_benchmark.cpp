@@ -4,12 +4,27 @@
 #include <iterator>
 #define ANKERL_NANOBENCH_IMPLEMENT
 #include <algorithm>
+#include <memory>
+#include <nodecode/address_map.hpp>
+#include <nodecode/backlinks.hpp>
+#include <nodecode/concurrent_array.hpp>
+#include <nodecode/gather.hpp>
 #include <nodecode/index_ptr.hpp>
+#include <nodecode/interleave.hpp>
+#include <nodecode/packed_index_array.hpp>
+#include <nodecode/partitioned_gather.hpp>
+#include <nodecode/prefetch.hpp>
+#include <nodecode/relayout.hpp>
+#include <nodecode/tagged_index_ptr.hpp>
+#include <nodecode/validate.hpp>
 #include <gtest/gtest.h>
 #include <nanobench.h>
+#include <numeric>
 #include <random>
 #include <limits>
 #include <string>
+#include <thread>
+#include <variant>
 
 using namespace ankerl;
 using namespace nodecode;
@@ -162,10 +177,550 @@ TEST(Benchmark, SumIndexedData) {
         ankerl::nanobench::doNotOptimizeAway(sum6);
       });
 
+  bound_view<&Header::m_data> view(header);
+  uint32_t sum7 = 0;
+  nanobench::Bench()
+      .minEpochTime(std::chrono::milliseconds(50))
+      .run("foreach += view[ptr]", [&] {
+        sum7 = 0;
+        for(auto& ptr : header.m_indexptrs)
+          sum7 += view[ptr];
+        ankerl::nanobench::doNotOptimizeAway(sum7);
+      });
+
+  uint32_t sum8 = 0;
+  nanobench::Bench()
+      .minEpochTime(std::chrono::milliseconds(50))
+      .run("std::accumulate *view.bind(ptr)", [&] {
+        sum8 = std::accumulate(
+            header.m_indexptrs.begin(), header.m_indexptrs.end(), 0,
+            [&view](uint32_t sum, auto& ptr) { return sum + *view.bind(ptr); });
+        ankerl::nanobench::doNotOptimizeAway(sum8);
+      });
+
+  uint32_t sum9 = 0;
+  nanobench::Bench()
+      .minEpochTime(std::chrono::milliseconds(50))
+      .run("gather_reduce(ptrs, header)", [&] {
+        sum9 = gather_reduce(header.m_indexptrs, header, uint32_t(0));
+        ankerl::nanobench::doNotOptimizeAway(sum9);
+      });
+
+  std::vector<uint32_t> gathered(header.m_indexptrs.size());
+  uint32_t sum10 = 0;
+  nanobench::Bench()
+      .minEpochTime(std::chrono::milliseconds(50))
+      .run("gather(ptrs, header, out) + std::accumulate", [&] {
+        gather(header.m_indexptrs, header, gathered);
+        sum10 = std::accumulate(gathered.begin(), gathered.end(), 0u);
+        ankerl::nanobench::doNotOptimizeAway(sum10);
+      });
+
   EXPECT_EQ(sum0, sum1);
   EXPECT_EQ(sum0, sum2);
   EXPECT_EQ(sum0, sum3);
   EXPECT_EQ(sum0, sum4);
   EXPECT_EQ(sum0, sum5);
   EXPECT_EQ(sum0, sum6);
+  EXPECT_EQ(sum0, sum7);
+  EXPECT_EQ(sum0, sum8);
+  EXPECT_EQ(sum0, sum9);
+  EXPECT_EQ(sum0, sum10);
+}
+
+TEST(Benchmark, Chain) {
+  struct Node;
+  struct ChainHeader {
+    std::vector<Node> nodes;
+  };
+  struct Node {
+    uint32_t                        value;
+    index_ptr<&ChainHeader::nodes>  next;
+  };
+
+  // One random cycle through every node
+  auto values = uniform_random_vector<uint32_t>(1000000, 100);
+  std::vector<uint32_t> order(values.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::shuffle(order.begin(), order.end(), std::mt19937(42));
+  ChainHeader header{std::vector<Node>(values.size())};
+  for (size_t i = 0; i < order.size(); ++i)
+    header.nodes[order[i]] = {values[order[i]],
+                              order[(i + 1) % order.size()]};
+
+  uint32_t sum0 = 0;
+  nanobench::Bench()
+      .minEpochTime(std::chrono::milliseconds(50))
+      .run("chain nodes[node.next]", [&] {
+        sum0 = 0;
+        uint32_t index = 0;
+        for (size_t i = 0; i < header.nodes.size(); ++i) {
+          sum0 += header.nodes[index].value;
+          index = header.nodes[index].next;
+        }
+        ankerl::nanobench::doNotOptimizeAway(sum0);
+      });
+
+  uint32_t sum1 = 0;
+  {
+    bound_header bound(header);
+    nanobench::Bench()
+        .minEpochTime(std::chrono::milliseconds(50))
+        .run("chain *node.next", [&] {
+          sum1 = 0;
+          const Node* node = &header.nodes[0];
+          for (size_t i = 0; i < header.nodes.size(); ++i) {
+            sum1 += node->value;
+            node = &*node->next;
+          }
+          ankerl::nanobench::doNotOptimizeAway(sum1);
+        });
+  }
+
+  uint32_t sum2 = 0;
+  bound_view<&ChainHeader::nodes> view(header);
+  nanobench::Bench()
+      .minEpochTime(std::chrono::milliseconds(50))
+      .run("chain view[node.next]", [&] {
+        sum2 = 0;
+        const Node* node = &header.nodes[0];
+        for (size_t i = 0; i < header.nodes.size(); ++i) {
+          sum2 += node->value;
+          node = &view[node->next];
+        }
+        ankerl::nanobench::doNotOptimizeAway(sum2);
+      });
+
+  EXPECT_EQ(sum0, sum1);
+  EXPECT_EQ(sum0, sum2);
+}
+
+// Smoke test; index_ptr_bench sweeps sizes and distances
+TEST(Benchmark, Prefetch) {
+  struct PrefetchHeader {
+    std::vector<uint32_t>                          data;
+    std::vector<index_ptr<&PrefetchHeader::data>>  ptrs;
+  };
+
+  PrefetchHeader header;
+  header.data  = uniform_random_vector<uint32_t>(1000000, 100);
+  auto indices = uniform_random_vector<uint32_t>(1000000, 999999);
+  header.ptrs.assign(indices.begin(), indices.end());
+
+  uint32_t sum0 = 0;
+  nanobench::Bench()
+      .minEpochTime(std::chrono::milliseconds(50))
+      .run("foreach += *ptr.bind(header)", [&] {
+        sum0 = 0;
+        for (auto& ptr : header.ptrs)
+          sum0 += *ptr.bind(header);
+        ankerl::nanobench::doNotOptimizeAway(sum0);
+      });
+
+  uint32_t sum1 = 0;
+  nanobench::Bench()
+      .minEpochTime(std::chrono::milliseconds(50))
+      .run("foreach += prefetch_view", [&] {
+        sum1 = 0;
+        for (auto value : prefetch_view(header.ptrs, header))
+          sum1 += value;
+        ankerl::nanobench::doNotOptimizeAway(sum1);
+      });
+  EXPECT_EQ(sum0, sum1);
+}
+
+// Smoke test; index_ptr_bench sweeps sizes past the last level cache
+TEST(Benchmark, PartitionedGather) {
+  struct GatherHeader {
+    std::vector<uint32_t>                        data;
+    std::vector<index_ptr<&GatherHeader::data>>  ptrs;
+  };
+
+  GatherHeader header;
+  header.data  = uniform_random_vector<uint32_t>(1000000, 100);
+  auto indices = uniform_random_vector<uint32_t>(1000000, 999999);
+  header.ptrs.assign(indices.begin(), indices.end());
+  std::vector<uint32_t> out(header.ptrs.size());
+
+  uint32_t sum0 = 0;
+  nanobench::Bench()
+      .minEpochTime(std::chrono::milliseconds(50))
+      .run("foreach += *ptr.bind(header)", [&] {
+        sum0 = 0;
+        for (auto& ptr : header.ptrs)
+          sum0 += *ptr.bind(header);
+        ankerl::nanobench::doNotOptimizeAway(sum0);
+      });
+
+  uint32_t sum1 = 0;
+  nanobench::Bench()
+      .minEpochTime(std::chrono::milliseconds(50))
+      .run("partitioned_gather then sum", [&] {
+        partitioned_gather(header.ptrs, header, out);
+        sum1 = std::accumulate(out.begin(), out.end(), 0u);
+        ankerl::nanobench::doNotOptimizeAway(sum1);
+      });
+  EXPECT_EQ(sum0, sum1);
+}
+
+// Smoke test; index_ptr_bench sweeps sizes past the last level cache
+TEST(Benchmark, Backlinks) {
+  struct GraphHeader {
+    std::vector<uint32_t>                            nodes;
+    std::vector<index_ptr<&GraphHeader::nodes>>      edges;
+    std::vector<index_ptr<&GraphHeader::edges>>      backlinks;
+    std::vector<index_span<&GraphHeader::backlinks>> incoming;
+  };
+
+  constexpr size_t size = 1000000;
+  GraphHeader      header;
+  header.nodes.resize(size / 8);
+  auto targets = uniform_random_vector<uint32_t>(size, uint32_t(size / 8 - 1));
+  header.edges.assign(targets.begin(), targets.end());
+
+  nanobench::Bench()
+      .minEpochTime(std::chrono::milliseconds(50))
+      .run("build_backlinks", [&] {
+        build_backlinks<index_refs<&GraphHeader::edges>,
+                        &GraphHeader::backlinks,
+                        index_refs<&GraphHeader::incoming>>(header);
+        ankerl::nanobench::doNotOptimizeAway(header.incoming[0]);
+      });
+  EXPECT_EQ(header.backlinks.size(), size);
+}
+
+// Smoke test; index_ptr_bench sweeps sizes past the last level cache
+TEST(Benchmark, ConvertGraph) {
+  struct Node {
+    uint32_t value;
+    Node*    next;
+  };
+  struct Converted;
+  struct GraphHeader {
+    std::vector<Converted> nodes;
+  };
+  struct Converted {
+    uint32_t                       value;
+    index_ptr<&GraphHeader::nodes> next;
+  };
+
+  // Separate allocations, listed in an order unrelated to their addresses
+  constexpr size_t                   size = 1000000;
+  std::vector<std::unique_ptr<Node>> nodes(size);
+  for (auto& node : nodes)
+    node = std::make_unique<Node>();
+  auto next = uniform_random_vector<uint32_t>(size, uint32_t(size - 1));
+  for (size_t i = 0; i < size; ++i)
+    *nodes[i] = {uint32_t(i), nodes[next[i]].get()};
+  std::ranges::shuffle(nodes, std::mt19937(0));
+
+  std::unique_ptr<address_map<Node>> map;
+  nanobench::Bench()
+      .minEpochTime(std::chrono::milliseconds(50))
+      .run("address_map", [&] {
+        map = std::make_unique<address_map<Node>>(nodes);
+        ankerl::nanobench::doNotOptimizeAway(map->size());
+      });
+
+  GraphHeader header;
+  nanobench::Bench()
+      .minEpochTime(std::chrono::milliseconds(50))
+      .run("convert_objects", [&] {
+        convert_objects<&GraphHeader::nodes>(
+            header, nodes, [&](const Node& node) {
+              return Converted{
+                  node.value,
+                  map->to_index_ptr<&GraphHeader::nodes>(node.next)};
+            });
+        ankerl::nanobench::doNotOptimizeAway(header.nodes[0]);
+      });
+  EXPECT_EQ(header.nodes.size(), size);
+}
+
+TEST(Benchmark, Interleave) {
+  struct Node;
+  struct ChainHeader {
+    std::vector<Node> nodes;
+  };
+  struct Node {
+    uint32_t                        value;
+    index_ptr<&ChainHeader::nodes>  next;
+  };
+
+  auto walk = [](ChainHeader& header, index_ptr<&ChainHeader::nodes> node,
+                 int hops, uint32_t& sum) -> interleaved_task {
+    for (int i = 0; i < hops; ++i) {
+      const Node& n = co_await fetch(node, header);
+      sum += n.value;
+      node = n.next;
+    }
+  };
+
+  constexpr size_t size  = 1000000;
+  constexpr size_t walks = 100000;
+  constexpr int    hops  = 20;
+  ChainHeader      header;
+  auto values = uniform_random_vector<uint32_t>(size, 100);
+  auto next   = uniform_random_vector<uint32_t>(size, uint32_t(size - 1));
+  header.nodes.resize(size);
+  for (size_t i = 0; i < size; ++i)
+    header.nodes[i] = {values[i], next[i]};
+  auto start = [&](size_t walk) { return uint32_t(walk * 7919 % size); };
+
+  uint32_t sum0 = 0;
+  nanobench::Bench()
+      .minEpochTime(std::chrono::milliseconds(50))
+      .batch(walks * hops)
+      .run("serial chains", [&] {
+        sum0 = 0;
+        for (size_t w = 0; w < walks; ++w) {
+          index_ptr<&ChainHeader::nodes> node(start(w));
+          for (int i = 0; i < hops; ++i) {
+            const Node& n = *node.bind(header);
+            sum0 += n.value;
+            node = n.next;
+          }
+        }
+        ankerl::nanobench::doNotOptimizeAway(sum0);
+      });
+
+  uint32_t sum1 = 0;
+  nanobench::Bench()
+      .minEpochTime(std::chrono::milliseconds(50))
+      .batch(walks * hops)
+      .run("interleave", [&] {
+        sum1 = 0;
+        interleave(walks, [&](size_t w) {
+          return walk(header, start(w), hops, sum1);
+        });
+        ankerl::nanobench::doNotOptimizeAway(sum1);
+      });
+  EXPECT_EQ(sum0, sum1);
+}
+
+TEST(Benchmark, TaggedIndexPtr) {
+  struct TaggedHeader {
+    std::vector<uint32_t> small;
+    std::vector<uint64_t> large;
+  };
+  using Tagged = tagged_index_ptr<&TaggedHeader::small, &TaggedHeader::large>;
+  using Variant = std::variant<index_ptr<&TaggedHeader::small>,
+                               index_ptr<&TaggedHeader::large>>;
+
+  TaggedHeader header;
+  header.small = uniform_random_vector<uint32_t>(1000000, 100);
+  auto large   = uniform_random_vector<uint32_t>(1000000, 100);
+  header.large.assign(large.begin(), large.end());
+  auto which   = uniform_random_vector<uint32_t>(1000000, 1);
+  auto indices = uniform_random_vector<uint32_t>(1000000, 999999);
+  std::vector<Tagged>  tagged;
+  std::vector<Variant> variants;
+  for (size_t i = 0; i < indices.size(); ++i) {
+    if (which[i]) {
+      tagged.push_back(index_ptr<&TaggedHeader::large>(indices[i]));
+      variants.push_back(index_ptr<&TaggedHeader::large>(indices[i]));
+    } else {
+      tagged.push_back(index_ptr<&TaggedHeader::small>(indices[i]));
+      variants.push_back(index_ptr<&TaggedHeader::small>(indices[i]));
+    }
+  }
+  auto add = [](uint64_t& sum) {
+    return [&sum](const auto& value) { sum += value; };
+  };
+
+  uint64_t sum0 = 0;
+  nanobench::Bench()
+      .minEpochTime(std::chrono::milliseconds(50))
+      .run("std::visit std::variant<index_ptr...>", [&] {
+        sum0 = 0;
+        for (auto& v : variants)
+          std::visit([&](auto ptr) { sum0 += *ptr.bind(header); }, v);
+        ankerl::nanobench::doNotOptimizeAway(sum0);
+      });
+
+  uint64_t sum1 = 0;
+  nanobench::Bench()
+      .minEpochTime(std::chrono::milliseconds(50))
+      .run("tagged_index_ptr::visit", [&] {
+        sum1 = 0;
+        for (auto& ptr : tagged)
+          ptr.visit(header, add(sum1));
+        ankerl::nanobench::doNotOptimizeAway(sum1);
+      });
+  EXPECT_EQ(sum0, sum1);
+
+  uint64_t sum2 = 0;
+  nanobench::Bench()
+      .minEpochTime(std::chrono::milliseconds(50))
+      .run("for_each_by_tag", [&] {
+        sum2 = 0;
+        for_each_by_tag(tagged, header, add(sum2));
+        ankerl::nanobench::doNotOptimizeAway(sum2);
+      });
+  EXPECT_EQ(sum0, sum2);
+}
+
+TEST(Benchmark, PackedIndices) {
+  // Under 2^20 targets, so 20 bits per index instead of 32
+  auto   data    = uniform_random_vector<uint32_t>(1000000, 100);
+  auto   indices = uniform_random_vector<uint32_t>(data.size(), data.size() - 1);
+  Header header(data, indices);
+  packed_index_array<&Header::m_data, 20> packed(header.m_indices);
+
+  uint32_t sum0 = 0;
+  nanobench::Bench()
+      .minEpochTime(std::chrono::milliseconds(50))
+      .run("std::accumulate std::vector<index_ptr>", [&] {
+        sum0 = std::accumulate(header.m_indexptrs.begin(), header.m_indexptrs.end(), 0u);
+        ankerl::nanobench::doNotOptimizeAway(sum0);
+      });
+
+  uint32_t sum1 = 0;
+  nanobench::Bench()
+      .minEpochTime(std::chrono::milliseconds(50))
+      .run("foreach += packed.get(i)", [&] {
+        sum1 = 0;
+        for (size_t i = 0; i < packed.size(); ++i)
+          sum1 += packed.get(i);
+        ankerl::nanobench::doNotOptimizeAway(sum1);
+      });
+
+  uint32_t sum2 = 0;
+  std::vector<uint32_t> chunk(4096);
+  nanobench::Bench()
+      .minEpochTime(std::chrono::milliseconds(50))
+      .run("packed.unpack() chunks + std::accumulate", [&] {
+        sum2 = 0;
+        for (size_t i = 0; i < packed.size(); i += chunk.size()) {
+          auto out = std::span(chunk).first(std::min(chunk.size(), packed.size() - i));
+          packed.unpack(i, out);
+          sum2 = std::accumulate(out.begin(), out.end(), sum2);
+        }
+        ankerl::nanobench::doNotOptimizeAway(sum2);
+      });
+
+  EXPECT_EQ(sum0, sum1);
+  EXPECT_EQ(sum0, sum2);
+}
+
+TEST(Benchmark, Relayout) {
+  struct Node;
+  struct ChainHeader {
+    std::vector<Node> nodes;
+  };
+  struct Node {
+    uint32_t                        value;
+    index_ptr<&ChainHeader::nodes>  next;
+  };
+
+  auto values = uniform_random_vector<uint32_t>(1000000, 100);
+  std::vector<uint32_t> order(values.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::shuffle(order.begin(), order.end(), std::mt19937(42));
+  ChainHeader header{std::vector<Node>(values.size())};
+  for (size_t i = 0; i < order.size(); ++i)
+    header.nodes[order[i]] = {values[order[i]],
+                              order[(i + 1) % order.size()]};
+
+  bound_view<&ChainHeader::nodes> view(header);
+  auto walk = [&] {
+    uint32_t    sum  = 0;
+    const Node* node = &header.nodes[0];
+    for (size_t i = 0; i < header.nodes.size(); ++i) {
+      sum += node->value;
+      node = &view[node->next];
+    }
+    return sum;
+  };
+
+  uint32_t sum0 = 0;
+  nanobench::Bench()
+      .minEpochTime(std::chrono::milliseconds(50))
+      .run("chain view[node.next] shuffled", [&] {
+        sum0 = walk();
+        ankerl::nanobench::doNotOptimizeAway(sum0);
+      });
+
+  auto bfs = bfs_order(header.nodes.size(), std::vector<size_t>{0},
+                       [&](size_t i) {
+                         return std::views::single(size_t(header.nodes[i].next));
+                       });
+  // Runs alternate between the BFS order and its inverse, which restores
+  // the shuffle, so every run moves every node
+  std::vector<size_t> unbfs(bfs.size());
+  for (size_t i = 0; i < bfs.size(); ++i)
+    unbfs[bfs[i]] = i;
+  bool inBfs  = false;
+  auto toggle = [&] {
+    relayout<&ChainHeader::nodes,
+             index_refs<&ChainHeader::nodes, &Node::next>>(
+        header, inBfs ? unbfs : bfs);
+    inBfs = !inBfs;
+  };
+  nanobench::Bench()
+      .minEpochTime(std::chrono::milliseconds(50))
+      .epochs(1)
+      .run("relayout bfs order", toggle);
+  if (!inBfs)
+    toggle();
+  // A chain in BFS order is sequential
+  EXPECT_EQ(uint32_t(header.nodes[0].next), 1u);
+
+  uint32_t sum1 = 0;
+  nanobench::Bench()
+      .minEpochTime(std::chrono::milliseconds(50))
+      .run("chain view[node.next] after relayout", [&] {
+        sum1 = walk();
+        ankerl::nanobench::doNotOptimizeAway(sum1);
+      });
+
+  EXPECT_EQ(sum0, sum1);
+}
+
+TEST(Benchmark, Validate) {
+  auto   data    = uniform_random_vector<uint32_t>(10000000, 100);
+  auto   indices = uniform_random_vector<uint32_t>(data.size(), data.size() - 1);
+  Header header(data, indices);
+
+  nanobench::Bench()
+      .minEpochTime(std::chrono::milliseconds(50))
+      .run("validate 10M index_ptr", [&] {
+        auto validated = validate<index_refs<&Header::m_indexptrs>>(header);
+        ankerl::nanobench::doNotOptimizeAway(validated);
+      });
+
+  nanobench::Bench()
+      .minEpochTime(std::chrono::milliseconds(50))
+      .run("validate 10M index_ptr single thread", [&] {
+        auto validated = validate<index_refs<&Header::m_indexptrs>>(
+            header, default_parallel_chunk * 16, 1);
+        ankerl::nanobench::doNotOptimizeAway(validated);
+      });
+}
+
+TEST(Benchmark, ConcurrentAppend) {
+  struct AppendHeader {
+    concurrent_array<uint32_t> values;
+  };
+  constexpr size_t perThread = 1000000;
+  for (size_t threadCount : {size_t(1), size_t(4)}) {
+    nanobench::Bench()
+        .minEpochTime(std::chrono::milliseconds(50))
+        .batch(perThread * threadCount)
+        .unit("append")
+        .run("concurrent_array append " + std::to_string(threadCount) +
+                 " threads",
+             [&] {
+               AppendHeader             header;
+               std::vector<std::thread> threads;
+               for (size_t t = 0; t < threadCount; ++t)
+                 threads.emplace_back([&] {
+                   for (size_t i = 0; i < perThread; ++i)
+                     append<&AppendHeader::values>(header, uint32_t(i));
+                 });
+               for (auto& thread : threads)
+                 thread.join();
+               ankerl::nanobench::doNotOptimizeAway(header.values.size());
+             });
+  }
 }
@@ -0,0 +1,178 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#include <cstdint>
+#include <gtest/gtest.h>
+#include <nodecode/compact.hpp>
+#include <nodecode/index_ptr.hpp>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+
+using namespace nodecode;
+
+namespace compact_test {
+
+struct Foo;
+struct Bar;
+
+struct Header {
+  std::vector<Foo>                      foos;
+  std::vector<Bar>                      bars;
+  std::vector<index_ptr<&Header::foos>> roots;
+};
+
+struct Foo {
+  std::string              data;
+  index_ptr<&Header::foos> next;
+};
+
+struct Bar {
+  std::string               data;
+  index_ptr<&Header::foos>  foo;
+  index_span<&Header::foos> children;
+};
+
+using FooRefs = std::tuple<index_refs<&Header::foos, &Foo::next>,
+                           index_refs<&Header::bars, &Bar::foo>,
+                           index_refs<&Header::bars, &Bar::children>,
+                           index_refs<&Header::roots>>;
+
+template <class... R, class Removed>
+std::vector<size_t> compact_foos(Header& header, Removed& removed,
+                                 std::tuple<R...>) {
+  return compact<&Header::foos, R...>(header, removed, 2, 3);
+}
+
+} // namespace compact_test
+
+using namespace compact_test;
+
+TEST(Compact, SlotAllocator) {
+  Header                        header;
+  slot_allocator<&Header::foos> slots;
+  auto a = slots.emplace(header, "a", 0u);
+  auto b = slots.emplace(header, "b", 0u);
+  auto c = slots.emplace(header, "c", 0u);
+  EXPECT_EQ(uint32_t(c), 2);
+  slots.erase(header, a);
+  slots.erase(header, c);
+  EXPECT_EQ(slots.free_count(), 2);
+  EXPECT_FALSE(slots.live(0));
+  EXPECT_TRUE(slots.live(1));
+  EXPECT_EQ(header.foos[0].data, "");
+  EXPECT_THROW(slots.erase(header, a), std::invalid_argument);
+  // Most recently freed first
+  EXPECT_EQ(uint32_t(slots.emplace(header, "d", b)), 2);
+  EXPECT_EQ(uint32_t(slots.emplace(header, "e", b)), 0);
+  EXPECT_EQ(uint32_t(slots.emplace(header, "f", b)), 3);
+  EXPECT_EQ(header.foos.size(), 4);
+  EXPECT_EQ(header.foos[2].data, "d");
+  // Appended directly, then erased through the allocator
+  header.foos.push_back({"g", 0});
+  slots.erase(header, 4);
+  EXPECT_EQ(slots.removed().size(), 5);
+  EXPECT_THROW(slots.erase(header, 5), std::out_of_range);
+}
+
+TEST(Compact, Rewrite) {
+  Header header;
+  for (uint32_t i = 0; i < 8; ++i)
+    header.foos.push_back({"foo" + std::to_string(i), (i + 2) % 8});
+  // Live foos must not point at the removed 1, 3 and 6. Removed foos may.
+  header.foos[4].next = 7;
+  header.foos[7].next = 4;
+  header.bars  = {
+      {"bar0", 7, {4, 2}},
+      {"bar1", 0, {0, 1}},
+  };
+  header.roots = {2, 5};
+  std::vector<bool> removed{false, true, false, true, false, false, true};
+  auto newIndex = compact_foos(header, removed, FooRefs{});
+  EXPECT_EQ(newIndex, (std::vector<size_t>{0, removed_index, 1, removed_index,
+                                           2, 3, removed_index, 4}));
+  ASSERT_EQ(header.foos.size(), 5);
+  bound_header bound(header);
+  EXPECT_EQ(header.foos[4].data, "foo7");
+  EXPECT_EQ(header.foos[0].next->data, "foo2");
+  EXPECT_EQ(header.foos[1].next->data, "foo4");
+  EXPECT_EQ(header.foos[2].next->data, "foo7");
+  EXPECT_EQ(header.foos[4].next->data, "foo4");
+  EXPECT_EQ(header.bars[0].foo->data, "foo7");
+  EXPECT_EQ(header.bars[0].children.index(), 2);
+  EXPECT_EQ(header.bars[0].children[1].data, "foo5");
+  EXPECT_EQ(header.roots[1]->data, "foo5");
+}
+
+TEST(Compact, RemovedReferences) {
+  auto make = [] {
+    Header header;
+    for (uint32_t i = 0; i < 4; ++i)
+      header.foos.push_back({"foo" + std::to_string(i), i});
+    header.bars = {{"bar0", 0, {0, 2}}};
+    return header;
+  };
+  std::vector<bool> removed{false, false, true};
+  Header            header = make();
+  header.foos[3].next      = 2;
+  EXPECT_THROW(compact_foos(header, removed, FooRefs{}), std::invalid_argument);
+  EXPECT_EQ(header.foos.size(), 4);
+  header                  = make();
+  header.bars[0].children = {1, 2};
+  EXPECT_THROW(compact_foos(header, removed, FooRefs{}), std::invalid_argument);
+  // foos[2].next refers to itself, but foos[2] is removed too
+  header = make();
+  compact_foos(header, removed, FooRefs{});
+  EXPECT_EQ(header.foos.size(), 3);
+  EXPECT_EQ(header.foos[2].data, "foo3");
+  EXPECT_EQ(uint32_t(header.foos[2].next), 2);
+}
+
+TEST(Compact, ThrowLeavesHeader) {
+  Header header;
+  for (uint32_t i = 0; i < 6; ++i)
+    header.foos.push_back({"foo" + std::to_string(i), (i + 3) % 6});
+  header.bars  = {{"bar0", 5, {3, 2}}, {"bar1", 4, {0, 0}}};
+  header.roots = {5, 4, 3, 2};
+  // Foo and bar references are valid and would be rewritten. Only the last
+  // root refers to a removed foo.
+  std::vector<bool> removed{false, true, true};
+  header.foos[4].next = 0;
+  header.foos[5].next = 5;
+  Header before       = header;
+  EXPECT_THROW(compact_foos(header, removed, FooRefs{}), std::invalid_argument);
+  ASSERT_EQ(header.foos.size(), before.foos.size());
+  for (size_t i = 0; i < header.foos.size(); ++i)
+    EXPECT_EQ(uint32_t(header.foos[i].next), uint32_t(before.foos[i].next));
+  for (size_t i = 0; i < header.bars.size(); ++i) {
+    EXPECT_EQ(uint32_t(header.bars[i].foo), uint32_t(before.bars[i].foo));
+    EXPECT_EQ(header.bars[i].children.index(),
+              before.bars[i].children.index());
+  }
+  for (size_t i = 0; i < header.roots.size(); ++i)
+    EXPECT_EQ(uint32_t(header.roots[i]), uint32_t(before.roots[i]));
+}
+
+TEST(Compact, WithAllocator) {
+  Header                        header;
+  slot_allocator<&Header::foos> slots;
+  for (uint32_t i = 0; i < 10000; ++i)
+    slots.emplace(header, std::to_string(i), 0u);
+  // Each even foo points at the next even foo, all odd foos are erased
+  for (uint32_t i = 0; i < 10000; i += 2)
+    header.foos[i].next = (i + 2) % 10000;
+  for (uint32_t i = 1; i < 10000; i += 2)
+    slots.erase(header, i);
+  header.roots = {0, 5000};
+  compact_foos(header, slots, FooRefs{});
+  EXPECT_EQ(header.foos.size(), 5000);
+  EXPECT_EQ(slots.free_count(), 0);
+  EXPECT_TRUE(slots.live(4999));
+  bound_header bound(header);
+  for (uint32_t i = 0; i < 5000; ++i) {
+    ASSERT_EQ(header.foos[i].data, std::to_string(i * 2));
+    ASSERT_EQ(uint32_t(header.foos[i].next), (i + 1) % 5000);
+  }
+  EXPECT_EQ(header.roots[1]->data, "5000");
+  EXPECT_EQ(uint32_t(slots.emplace(header, "new", 0u)), 5000);
+}
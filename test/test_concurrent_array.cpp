@@ -0,0 +1,115 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <gtest/gtest.h>
+#include <nodecode/concurrent_array.hpp>
+#include <nodecode/index_ptr.hpp>
+#include <ranges>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+using namespace nodecode;
+
+namespace concurrent_array_test {
+
+struct Node;
+struct Header {
+  concurrent_array<Node, 4> nodes;
+};
+struct Node {
+  uint32_t                   value;
+  index_ptr<&Header::nodes>  parent;
+};
+
+} // namespace concurrent_array_test
+
+using namespace concurrent_array_test;
+
+TEST(ConcurrentArray, Segments) {
+  concurrent_array<uint32_t, 2> array;
+  for (uint32_t i = 0; i < 1000; ++i)
+    EXPECT_EQ(array.emplace_back(i), i);
+  ASSERT_EQ(array.size(), 1000);
+  for (uint32_t i = 0; i < 1000; ++i)
+    EXPECT_EQ(array[i], i);
+  EXPECT_TRUE(std::ranges::equal(array, std::views::iota(0u, 1000u)));
+  const uint32_t* first = &array[0];
+  array.emplace_back(1000u);
+  EXPECT_EQ(&array[0], first);
+}
+
+TEST(ConcurrentArray, IndexPtr) {
+  Header header;
+  auto   root  = append<&Header::nodes>(header, Node{1, 0});
+  auto   child = append<&Header::nodes>(header, Node{2, root});
+  EXPECT_EQ(static_cast<uint32_t>(child), 1);
+  EXPECT_EQ(child.bind(header)->value, 2);
+  EXPECT_EQ(child.bind(header)->parent.bind(header)->value, 1);
+  bound_view<&Header::nodes> view(header);
+  for (uint32_t i = 2; i < 100; ++i)
+    append<&Header::nodes>(header, Node{i + 1, i - 1});
+  // A view made before the appends still reaches the new objects
+  EXPECT_EQ(view[view[index_ptr<&Header::nodes>(99)].parent].value, 99);
+  bound_header bound(header);
+  EXPECT_EQ(index_ptr<&Header::nodes>(50)->value, 51);
+}
+
+TEST(ConcurrentArray, IndexTypeFull) {
+  Header header;
+  for (uint32_t i = 0; i < 256; ++i)
+    append<&Header::nodes, uint8_t>(header, Node{i, 0});
+  // Nothing is constructed for an index the IndexType cannot hold
+  EXPECT_THROW((append<&Header::nodes, uint8_t>(header, Node{256, 0})),
+               std::out_of_range);
+  EXPECT_EQ(header.nodes.size(), 256);
+  // and no slot is left claimed, so wider appends carry on
+  EXPECT_EQ(uint32_t(append<&Header::nodes>(header, Node{256, 0})), 256);
+  EXPECT_EQ(header.nodes.size(), 257);
+  EXPECT_EQ(header.nodes[256].value, 256);
+}
+
+TEST(ConcurrentArray, ConcurrentWriters) {
+  constexpr uint32_t threadCount = 4, perThread = 100000;
+  Header             header;
+  std::atomic<bool>  done = false;
+  std::atomic<bool>  bad  = false;
+
+  // Reads everything published while the writers append
+  std::thread reader([&] {
+    while (!done) {
+      size_t size = header.nodes.size();
+      for (size_t i = 0; i < size; ++i) {
+        auto& node = header.nodes[i];
+        if (node.value % perThread != 0 &&
+            node.parent.bind(header)->value != node.value - 1)
+          bad = true;
+      }
+    }
+  });
+
+  std::vector<std::thread> writers;
+  for (uint32_t t = 0; t < threadCount; ++t) {
+    writers.emplace_back([&, t] {
+      index_ptr<&Header::nodes> previous;
+      for (uint32_t i = 0; i < perThread; ++i)
+        previous = append<&Header::nodes>(
+            header, Node{t * perThread + i, previous});
+    });
+  }
+  for (auto& writer : writers)
+    writer.join();
+  done = true;
+  reader.join();
+
+  EXPECT_FALSE(bad);
+  ASSERT_EQ(header.nodes.size(), threadCount * perThread);
+  std::vector<uint32_t> values;
+  for (auto& node : header.nodes)
+    values.push_back(node.value);
+  std::ranges::sort(values);
+  EXPECT_TRUE(std::ranges::equal(values,
+                                 std::views::iota(0u, threadCount * perThread)));
+}
@@ -0,0 +1,180 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#include <cstdint>
+#include <functional>
+#include <gtest/gtest.h>
+#include <nodecode/gather.hpp>
+#include <nodecode/index_ptr.hpp>
+#include <numeric>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace nodecode;
+
+namespace gather_test {
+
+struct Header {
+  std::vector<uint32_t> u32;
+  std::vector<uint64_t> u64;
+  std::vector<float>    f32;
+  std::string           chars;
+};
+
+// Odd sizes exercise the scalar tail after full SIMD lanes
+std::vector<uint32_t> scrambled_indices(size_t size, size_t range) {
+  std::vector<uint32_t> result(size);
+  for (size_t i = 0; i < size; ++i)
+    result[i] = uint32_t((i * 7919 + 13) % range);
+  return result;
+}
+
+Header make_header(size_t size) {
+  Header header;
+  for (size_t i = 0; i < size; ++i) {
+    header.u32.push_back(uint32_t(i * 3 + 1));
+    header.u64.push_back(uint64_t(i) << 33 | i);
+    header.f32.push_back(float(i) * 0.5f);
+    header.chars.push_back(char('a' + i % 26));
+  }
+  return header;
+}
+
+template <auto ObjectsPtr, class IndexType = uint32_t>
+std::vector<index_ptr<ObjectsPtr, IndexType>>
+make_ptrs(const std::vector<uint32_t>& indices) {
+  return {indices.begin(), indices.end()};
+}
+
+} // namespace gather_test
+
+using namespace gather_test;
+
+TEST(Gather, Uint32) {
+  Header header  = make_header(101);
+  auto   indices = scrambled_indices(37, 101);
+  auto   ptrs    = make_ptrs<&Header::u32>(indices);
+  std::vector<uint32_t> out(ptrs.size());
+  gather(ptrs, header, out);
+  for (size_t i = 0; i < indices.size(); ++i)
+    EXPECT_EQ(out[i], header.u32[indices[i]]);
+}
+
+TEST(Gather, Uint64) {
+  Header header  = make_header(101);
+  auto   indices = scrambled_indices(37, 101);
+  auto   ptrs    = make_ptrs<&Header::u64>(indices);
+  std::vector<uint64_t> out(ptrs.size());
+  gather(ptrs, header, out);
+  for (size_t i = 0; i < indices.size(); ++i)
+    EXPECT_EQ(out[i], header.u64[indices[i]]);
+}
+
+TEST(Gather, Float) {
+  Header header  = make_header(101);
+  auto   indices = scrambled_indices(37, 101);
+  auto   ptrs    = make_ptrs<&Header::f32>(indices);
+  std::vector<float> out(ptrs.size());
+  gather(std::span(ptrs), header, out);
+  for (size_t i = 0; i < indices.size(); ++i)
+    EXPECT_EQ(out[i], header.f32[indices[i]]);
+}
+
+TEST(Gather, ScalarFallback) {
+  // 1 byte values and 16 bit indices are never gathered with SIMD
+  Header header  = make_header(101);
+  auto   indices = scrambled_indices(37, 101);
+  auto   chars   = make_ptrs<&Header::chars>(indices);
+  auto   narrow  = make_ptrs<&Header::u32, uint16_t>(indices);
+  static_assert(!simd_gather_v<char, uint32_t>);
+  static_assert(!simd_gather_v<uint32_t, uint16_t>);
+  std::string           charsOut(chars.size(), '\0');
+  std::vector<uint64_t> widened(narrow.size());
+  gather(chars, header, charsOut);
+  gather(narrow, header, widened);
+  for (size_t i = 0; i < indices.size(); ++i) {
+    EXPECT_EQ(charsOut[i], header.chars[indices[i]]);
+    EXPECT_EQ(widened[i], header.u32[indices[i]]);
+  }
+}
+
+TEST(Gather, OutputTooSmall) {
+  Header header = make_header(10);
+  auto   ptrs   = make_ptrs<&Header::u32>(scrambled_indices(10, 10));
+  std::vector<uint32_t> out(ptrs.size() - 1);
+  EXPECT_THROW(gather(ptrs, header, out), std::out_of_range);
+}
+
+TEST(Gather, Empty) {
+  Header header = make_header(10);
+  std::vector<index_ptr<&Header::u32>> ptrs;
+  std::vector<uint32_t>                out;
+  gather(ptrs, header, out);
+  EXPECT_EQ(gather_reduce(ptrs, header, uint32_t(42)), 42u);
+}
+
+TEST(GatherReduce, Sum) {
+  Header header  = make_header(1001);
+  auto   indices = scrambled_indices(523, 1001);
+  auto   ptrs32  = make_ptrs<&Header::u32>(indices);
+  auto   ptrs64  = make_ptrs<&Header::u64>(indices);
+  uint32_t expected32 = 7;
+  uint64_t expected64 = 7;
+  for (auto index : indices) {
+    expected32 += header.u32[index];
+    expected64 += header.u64[index];
+  }
+  EXPECT_EQ(gather_reduce(ptrs32, header, uint32_t(7)), expected32);
+  EXPECT_EQ(gather_reduce(ptrs32, header, uint32_t(7), std::plus<uint32_t>()),
+            expected32);
+  EXPECT_EQ(gather_reduce(ptrs64, header, uint64_t(7)), expected64);
+}
+
+TEST(GatherReduce, Wraps) {
+  // Unsigned sums wrap identically whether reduced by lane or in order
+  Header header;
+  header.u32 = {0xffffffffu, 0x80000000u, 3};
+  std::vector<index_ptr<&Header::u32>> ptrs;
+  for (int i = 0; i < 100; ++i)
+    ptrs.push_back(uint32_t(i % 3));
+  uint32_t expected = 0;
+  for (auto& ptr : ptrs)
+    expected += header.u32[ptr];
+  EXPECT_EQ(gather_reduce(ptrs, header, uint32_t(0)), expected);
+}
+
+TEST(GatherReduce, OtherOps) {
+  Header header  = make_header(101);
+  auto   indices = scrambled_indices(37, 101);
+  auto   ptrs    = make_ptrs<&Header::u32>(indices);
+  auto   fptrs   = make_ptrs<&Header::f32>(indices);
+  uint32_t maxValue = 0;
+  float    fsum     = 0.0f;
+  for (auto index : indices) {
+    maxValue = std::max(maxValue, header.u32[index]);
+    fsum += header.f32[index];
+  }
+  EXPECT_EQ(gather_reduce(ptrs, header, uint32_t(0),
+                          [](uint32_t a, uint32_t b) { return std::max(a, b); }),
+            maxValue);
+  EXPECT_EQ(gather_reduce(fptrs, header, 0.0f), fsum);
+  // A wider accumulator than the value type takes the scalar path
+  EXPECT_EQ(gather_reduce(ptrs, header, uint64_t(0)),
+            std::accumulate(indices.begin(), indices.end(), uint64_t(0),
+                            [&](uint64_t sum, uint32_t index) {
+                              return sum + header.u32[index];
+                            }));
+}
+
+#if defined(NODECODE_TEST_SIMD_GATHER)
+// The AVX2 and AVX-512 test targets define this, so the cases above are
+// known to have taken the hardware gather paths
+TEST(Gather, SimdEnabled) {
+  static_assert(NODECODE_SIMD_GATHER);
+  static_assert(simd_gather_v<uint32_t, uint32_t>);
+  static_assert(simd_gather_v<double, uint32_t>);
+  EXPECT_EQ(gather_detail::lanes<uint32_t>,
+            NODECODE_TEST_SIMD_GATHER / 8 / sizeof(uint32_t));
+}
+#endif
@@ -0,0 +1,186 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#include <cstdint>
+#include <filesystem>
+#include <gtest/gtest.h>
+#include <nodecode/header_builder.hpp>
+#include <nodecode/index_ptr.hpp>
+#include <nodecode/mapped_file.hpp>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace nodecode;
+
+namespace header_builder_test {
+
+struct Foo;
+struct Bar;
+
+struct Header {
+  std::span<Foo>  foos;
+  std::span<Bar>  bars;
+  std::span<char> chars;
+};
+
+struct Foo {
+  std::string               data;
+  index_ptr<&Header::bars>  bar;
+  index_span<&Header::chars> name;
+};
+
+struct Bar {
+  int                      data;
+  index_ptr<&Header::foos> foo;
+};
+
+struct PodHeader {
+  std::span<uint32_t> values;
+  std::span<index_ptr<&PodHeader::values>> refs;
+};
+
+using Builder = header_builder<&Header::foos, &Header::bars, &Header::chars>;
+
+} // namespace header_builder_test
+
+using namespace header_builder_test;
+
+TEST(HeaderBuilder, Chain) {
+  Builder builder;
+  auto    foo0 = builder.emplace_back<&Header::foos>("foo0");
+  auto    foo1 = builder.emplace_back<&Header::foos>("foo1");
+  auto    bar0 = builder.emplace_back<&Header::bars>(20);
+  auto    bar1 = builder.emplace_back<&Header::bars>(21);
+  auto&   foos = builder.objects<&Header::foos>();
+  auto&   bars = builder.objects<&Header::bars>();
+  foos[foo0].bar = bar0;
+  foos[foo1].bar = bar1;
+  bars[bar0].foo = foo1;
+  bars[bar1].foo = foo0;
+  foos[foo0].name = builder.append_range<&Header::chars>(std::string("zero"));
+  foos[foo1].name = builder.append_range<&Header::chars>(std::string("one"));
+
+  auto arena = builder.build();
+  EXPECT_TRUE(builder.objects<&Header::foos>().empty());
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(arena.bytes().data()) %
+                file_section_alignment,
+            0);
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(arena->bars.data()) %
+                file_section_alignment,
+            0);
+
+  // Moving the arena does not move the objects
+  auto         moved = std::move(arena);
+  bound_header bound(*moved);
+  EXPECT_EQ(moved->foos[0].data, "foo0");
+  EXPECT_EQ(moved->foos[0].bar->data, 20);
+  EXPECT_EQ(moved->foos[0].bar->foo->data, "foo1");
+  EXPECT_EQ(moved->foos[0].bar->foo->bar->foo->data, "foo0");
+  EXPECT_EQ(moved->foos[0].name, std::string("zero"));
+  EXPECT_EQ(moved->foos[1].name, std::string("one"));
+}
+
+TEST(HeaderBuilder, ToIndexPtrs) {
+  Builder builder;
+  for (int i = 0; i < 10; ++i)
+    builder.emplace_back<&Header::bars>(i);
+  auto&             bars = builder.objects<&Header::bars>();
+  std::vector<Bar*> pointers{&bars[3], &bars[0], &bars[9]};
+  std::vector<index_ptr<&Header::bars>> ptrs;
+  builder.to_index_ptrs<&Header::bars>(pointers, std::back_inserter(ptrs));
+  EXPECT_EQ(ptrs, (std::vector<index_ptr<&Header::bars>>{3, 0, 9}));
+
+  std::vector<std::vector<Bar>::iterator> iterators{bars.begin() + 5,
+                                                    bars.begin() + 1};
+  ptrs.clear();
+  builder.to_index_ptrs<&Header::bars>(iterators, std::back_inserter(ptrs));
+  EXPECT_EQ(ptrs, (std::vector<index_ptr<&Header::bars>>{5, 1}));
+
+  Bar outside{0, 0};
+  EXPECT_THROW(builder.to_index_ptrs<&Header::bars>(
+                   std::vector<Bar*>{&outside}, std::back_inserter(ptrs)),
+               std::out_of_range);
+}
+
+TEST(HeaderBuilder, ToIndexSpans) {
+  Builder builder;
+  builder.append_range<&Header::chars>(std::string("hello world"));
+  auto&                          chars = builder.objects<&Header::chars>();
+  std::vector<std::span<char>>   words{std::span(chars).subspan(0, 5),
+                                       std::span(chars).subspan(6, 5)};
+  std::vector<index_span<&Header::chars>> spans;
+  builder.to_index_spans<&Header::chars>(words, std::back_inserter(spans));
+  ASSERT_EQ(spans.size(), 2);
+  EXPECT_EQ(spans[1].index(), 6);
+  EXPECT_EQ(spans[1].size(), 5);
+  std::string outside = "elsewhere";
+  EXPECT_THROW(builder.to_index_spans<&Header::chars>(
+                   std::vector{std::span(outside)}, std::back_inserter(spans)),
+               std::out_of_range);
+}
+
+TEST(HeaderBuilder, IndexTypeFull) {
+  Builder builder;
+  for (int i = 0; i < 256; ++i)
+    EXPECT_EQ(uint32_t(builder.emplace_back<&Header::bars, uint8_t>(i)),
+              uint32_t(i));
+  EXPECT_THROW((builder.emplace_back<&Header::bars, uint8_t>(256)),
+               std::out_of_range);
+  EXPECT_EQ(builder.objects<&Header::bars>().size(), 256);
+
+  builder.append_range<&Header::chars, uint8_t>(std::string(200, 'a'));
+  EXPECT_THROW(
+      (builder.append_range<&Header::chars, uint8_t>(std::string(100, 'b'))),
+      std::out_of_range);
+  EXPECT_EQ(builder.objects<&Header::chars>().size(), 200);
+  auto span =
+      builder.append_range<&Header::chars, uint8_t>(std::string(55, 'c'));
+  EXPECT_EQ(span.index(), 200);
+  EXPECT_EQ(span.size(), 55);
+
+  // Conversions check the same limits rather than truncating
+  builder.emplace_back<&Header::bars>(256);
+  builder.append_range<&Header::chars>(std::string(45, 'd'));
+  const auto& bars = builder.objects<&Header::bars>();
+  std::vector<index_ptr<&Header::bars, uint8_t>> ptrs;
+  std::vector<const Bar*> pointers{&bars[255]};
+  builder.to_index_ptrs<&Header::bars, uint8_t>(pointers,
+                                                std::back_inserter(ptrs));
+  EXPECT_EQ(uint32_t(ptrs.back()), 255);
+  pointers = {&bars[256]};
+  EXPECT_THROW((builder.to_index_ptrs<&Header::bars, uint8_t>(
+                   pointers, std::back_inserter(ptrs))),
+               std::out_of_range);
+  const auto& chars = builder.objects<&Header::chars>();
+  std::vector<index_span<&Header::chars, uint8_t>> spans;
+  std::vector<std::span<const char>> ranges{{chars.data() + 250, 5}};
+  builder.to_index_spans<&Header::chars, uint8_t>(ranges,
+                                                  std::back_inserter(spans));
+  EXPECT_EQ(spans.back().index(), 250);
+  ranges = {{chars.data() + 250, 7}};
+  EXPECT_THROW((builder.to_index_spans<&Header::chars, uint8_t>(
+                   ranges, std::back_inserter(spans))),
+               std::out_of_range);
+  EXPECT_EQ(spans.size(), 1);
+}
+
+TEST(HeaderBuilder, WriteArena) {
+  header_builder<&PodHeader::values, &PodHeader::refs> builder;
+  for (uint32_t i = 0; i < 100; ++i) {
+    builder.emplace_back<&PodHeader::values>(i * 2);
+    builder.emplace_back<&PodHeader::refs>(99 - i);
+  }
+  auto arena = builder.build();
+  auto path  = std::filesystem::temp_directory_path() /
+              "nodecode_header_builder_arena.bin";
+  arena.write(path);
+  EXPECT_EQ(std::filesystem::file_size(path), arena.bytes().size());
+
+  mapped_header<&PodHeader::values, &PodHeader::refs> mapped(path);
+  ASSERT_EQ(mapped->refs.size(), 100);
+  bound_header bound(*mapped);
+  EXPECT_EQ(*mapped->refs[0], 198);
+  EXPECT_EQ(*mapped->refs[99], 0);
+  std::filesystem::remove(path);
+}
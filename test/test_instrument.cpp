@@ -0,0 +1,110 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+// Built as its own executable with NODECODE_INSTRUMENT=1, so no other
+// translation unit sees index_ptr without the hooks
+
+#include <algorithm>
+#include <cstdint>
+#include <gtest/gtest.h>
+#include <nodecode/index_ptr.hpp>
+#include <nodecode/instrument.hpp>
+#include <nodecode/parallel.hpp>
+#include <sstream>
+#include <string>
+#include <vector>
+
+static_assert(NODECODE_INSTRUMENT, "Build with -DNODECODE_INSTRUMENT=1");
+
+using namespace nodecode;
+
+namespace instrument_test {
+
+struct Header {
+  std::vector<uint32_t>                   values;
+  std::vector<uint64_t>                   wide;
+  std::vector<index_ptr<&Header::values>> refs;
+};
+
+const instrument::array_stats* find(const std::vector<instrument::array_report>& reports,
+                                    std::string_view name) {
+  for (auto& report : reports)
+    if (report.name.find(name) != std::string_view::npos)
+      return &report.stats;
+  return nullptr;
+}
+
+} // namespace instrument_test
+
+using namespace instrument_test;
+
+TEST(Instrument, StridesAndLines) {
+  instrument::reset();
+  Header header;
+  header.values.resize(1024);
+  header.wide.resize(1024);
+  bound_header bound(header);
+  // 64 sequential derefs over 256 bytes of uint32_t
+  for (uint32_t i = 0; i < 64; ++i)
+    (void)*index_ptr<&Header::values>(i);
+  // Then 8 strided backwards by 128
+  for (uint32_t i = 8; i-- > 0;)
+    (void)*index_ptr<&Header::wide>(i * 128);
+
+  auto  reports = instrument::report();
+  auto* values  = find(reports, "values");
+  auto* wide    = find(reports, "wide");
+  ASSERT_TRUE(values);
+  ASSERT_TRUE(wide);
+  EXPECT_EQ(values->derefs, 64);
+  EXPECT_EQ(values->forward[1], 63);
+  auto lineOf = [](const void* p) {
+    return reinterpret_cast<uintptr_t>(p) / instrument::cache_line_size;
+  };
+  size_t lines = lineOf(&header.values[63]) - lineOf(&header.values[0]) + 1;
+  // Line counts are estimates, off by one if two lines share a register
+  EXPECT_NEAR(double(values->lines.size()), double(lines), 1.0);
+  EXPECT_EQ(wide->derefs, 8);
+  EXPECT_EQ(wide->backward[8], 7);
+  EXPECT_NEAR(double(wide->lines.size()), 8.0, 1.0);
+
+  std::ostringstream out;
+  instrument::dump(out);
+  EXPECT_NE(out.str().find("64 derefs, " +
+                           std::to_string(values->lines.size()) +
+                           " cache lines, strides +1:63"),
+            std::string::npos);
+}
+
+TEST(Instrument, Threads) {
+  instrument::reset();
+  Header header;
+  header.values.resize(100000);
+  for (uint32_t i = 0; i < 100000; ++i)
+    header.refs.push_back(i);
+  // Workers exit before parallel_for_each returns, so all are counted
+  parallel_for_each(header, header.refs, [](auto& ref) { (void)*ref; }, 1000,
+                    4);
+  auto  reports = instrument::report();
+  auto* values  = find(reports, "values");
+  ASSERT_TRUE(values);
+  EXPECT_EQ(values->derefs, 100000);
+  // Threads' sketches merge without counting shared lines twice
+  double lines = 100000.0 * sizeof(uint32_t) / instrument::cache_line_size;
+  EXPECT_NEAR(double(values->lines.size()), lines, lines * 0.1);
+  instrument::reset();
+  EXPECT_TRUE(instrument::report().empty());
+}
+
+TEST(Instrument, BoundView) {
+  instrument::reset();
+  Header header;
+  header.values.resize(10);
+  bound_view<&Header::values> view(header);
+  view[index_ptr<&Header::values>(3)] = 1;
+  view[index_ptr<&Header::values>(3)] += 1;
+  auto  reports = instrument::report();
+  auto* values  = find(reports, "values");
+  ASSERT_TRUE(values);
+  EXPECT_EQ(values->derefs, 2);
+  EXPECT_EQ(values->forward[0], 1);
+}
@@ -0,0 +1,117 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#include <cstdint>
+#include <gtest/gtest.h>
+#include <nodecode/index_ptr.hpp>
+#include <nodecode/interleave.hpp>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+using namespace nodecode;
+
+namespace interleave_test {
+
+struct Foo;
+struct Bar;
+
+struct Header {
+  std::vector<Foo> foos;
+  std::vector<Bar> bars;
+};
+
+struct Foo {
+  uint32_t                 value;
+  index_ptr<&Header::bars> bar;
+};
+
+struct Bar {
+  uint32_t                 value;
+  index_ptr<&Header::foos> foo;
+};
+
+Header make_header(uint32_t size) {
+  Header       header;
+  std::mt19937 rng(3);
+  for (uint32_t i = 0; i < size; ++i) {
+    header.foos.push_back({i, uint32_t(rng() % size)});
+    header.bars.push_back({i * 1000, uint32_t(rng() % size)});
+  }
+  return header;
+}
+
+uint64_t walk_serial(Header& header, index_ptr<&Header::foos> foo, int hops) {
+  uint64_t sum = 0;
+  for (int i = 0; i < hops; ++i) {
+    const Foo& f = *foo.bind(header);
+    const Bar& b = *f.bar.bind(header);
+    sum += f.value + b.value;
+    foo = b.foo;
+  }
+  return sum;
+}
+
+interleaved_task walk(Header& header, index_ptr<&Header::foos> foo, int hops,
+                      uint64_t& sum) {
+  for (int i = 0; i < hops; ++i) {
+    const Foo& f = co_await fetch(foo, header);
+    const Bar& b = co_await fetch(f.bar, header);
+    sum += f.value + b.value;
+    foo = b.foo;
+  }
+}
+
+} // namespace interleave_test
+
+using namespace interleave_test;
+
+TEST(Interleave, Chains) {
+  Header header = make_header(1000);
+  for (size_t group : {1, 3, 16, 5000}) {
+    constexpr size_t      walks = 200;
+    std::vector<uint64_t> sums(walks);
+    interleave(
+        walks,
+        [&](size_t i) {
+          return walk(header, uint32_t(i * 5), int(i % 7), sums[i]);
+        },
+        group);
+    for (size_t i = 0; i < walks; ++i)
+      ASSERT_EQ(sums[i], walk_serial(header, uint32_t(i * 5), int(i % 7)));
+  }
+  interleave(0, [&](size_t) -> interleaved_task { co_return; });
+}
+
+TEST(Interleave, BoundHeader) {
+  Header                header = make_header(100);
+  bound_header          bound(header);
+  std::vector<uint32_t> ends(10);
+  interleave(ends.size(), [&](size_t i) -> interleaved_task {
+    index_ptr<&Header::foos> foo{uint32_t(i)};
+    for (int hop = 0; hop < 3; ++hop) {
+      const Foo& f = co_await fetch(foo);
+      foo          = (co_await fetch(f.bar)).foo;
+    }
+    ends[i] = foo;
+  });
+  for (uint32_t i = 0; i < ends.size(); ++i) {
+    index_ptr<&Header::foos> foo(i);
+    for (int hop = 0; hop < 3; ++hop)
+      foo = foo->bar->foo;
+    EXPECT_EQ(ends[i], uint32_t(foo));
+  }
+}
+
+TEST(Interleave, Exception) {
+  int finished = 0;
+  auto make = [&](size_t i) -> interleaved_task {
+    int value = int(i);
+    co_await fetch(&value);
+    if (i == 5)
+      throw std::runtime_error("walk failed");
+    ++finished;
+  };
+  EXPECT_THROW(interleave(20, make, 4), std::runtime_error);
+  EXPECT_LT(finished, 20);
+}
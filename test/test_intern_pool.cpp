@@ -0,0 +1,118 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#include <gtest/gtest.h>
+#include <nodecode/header_builder.hpp>
+#include <nodecode/index_ptr.hpp>
+#include <nodecode/intern_pool.hpp>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+using namespace nodecode;
+
+namespace intern_pool_test {
+
+struct Header {
+  std::string               chars;
+  index_span<&Header::chars> a;
+  index_span<&Header::chars> b;
+};
+
+struct SpanHeader {
+  std::span<int> values;
+};
+
+std::string_view view(const Header& header, index_span<&Header::chars> span) {
+  return std::string_view(header.chars).substr(span.index(), span.size());
+}
+
+} // namespace intern_pool_test
+
+using namespace intern_pool_test;
+
+TEST(InternPool, Whole) {
+  Header                      header;
+  intern_pool<&Header::chars> pool(header.chars);
+  header.a = pool.intern("hello");
+  header.b = pool.intern(std::string("hello"));
+  EXPECT_EQ(header.a.index(), header.b.index());
+  EXPECT_EQ(header.chars, "hello");
+  auto world = pool.intern("world");
+  EXPECT_EQ(header.chars, "helloworld");
+  EXPECT_EQ(view(header, world), "world");
+  EXPECT_EQ(view(header, pool.intern("hello")), "hello");
+  // Substrings only match in suffix mode
+  EXPECT_EQ(pool.intern("llo").index(), 10);
+  EXPECT_EQ(pool.intern("").size(), 0);
+  EXPECT_EQ(pool.entries(), 3);
+  bound_header bound(header);
+  EXPECT_EQ(std::string(header.a.begin(), header.a.end()), "hello");
+}
+
+TEST(InternPool, Suffix) {
+  Header                      header;
+  intern_pool<&Header::chars> pool(header.chars, intern_mode::suffix);
+  auto                        helloWorld = pool.intern("hello world");
+  auto                        world      = pool.intern("world");
+  EXPECT_EQ(header.chars, "hello world");
+  EXPECT_EQ(world.index(), 6);
+  EXPECT_EQ(view(header, world), "world");
+  EXPECT_EQ(view(header, helloWorld), "hello world");
+  // Only a whole range can match, so "old world" is stored again, but its
+  // suffixes stop at " world", which was already there
+  auto old = pool.intern("old world");
+  EXPECT_EQ(old.index(), 11);
+  EXPECT_EQ(pool.intern("d world").index(), 13);
+  EXPECT_EQ(pool.intern("o world").index(), 4);
+  EXPECT_EQ(pool.entries(), 11 + 3);
+}
+
+TEST(InternPool, InPlace) {
+  Header header;
+  header.chars = "preloaded";
+  intern_pool<&Header::chars> pool(header.chars);
+  // Existing content is not matched by value
+  EXPECT_EQ(pool.intern("preloaded").index(), 9);
+  // but a range inside the array is registered where it is
+  auto load = pool.intern(std::string_view(header.chars).substr(3, 4));
+  EXPECT_EQ(load.index(), 3);
+  EXPECT_EQ(header.chars.size(), 18);
+  EXPECT_EQ(pool.intern("load").index(), 3);
+}
+
+TEST(InternPool, Builder) {
+  header_builder<&SpanHeader::values> builder;
+  intern_pool<&SpanHeader::values, uint8_t> pool(
+      builder.objects<&SpanHeader::values>());
+  std::vector<int> a{1, 2, 3}, b{4, 5};
+  EXPECT_EQ(pool.intern(a).index(), 0);
+  EXPECT_EQ(pool.intern(b).index(), 3);
+  EXPECT_EQ(pool.intern(a).index(), 0);
+  EXPECT_EQ(builder.objects<&SpanHeader::values>().size(), 5);
+  std::vector<int> big(300);
+  EXPECT_THROW(pool.intern(big), std::out_of_range);
+  auto arena = builder.build();
+  EXPECT_EQ(arena->values.size(), 5);
+}
+
+TEST(InternPool, ConcurrentInserts) {
+  constexpr int threadCount = 4, perThread = 10000, distinct = 500;
+  Header                        header;
+  intern_pool<&Header::chars>   pool(header.chars);
+  std::vector<std::vector<index_span<&Header::chars>>> results(threadCount);
+  std::vector<std::thread>                             threads;
+  for (int t = 0; t < threadCount; ++t)
+    threads.emplace_back([&, t] {
+      for (int i = 0; i < perThread; ++i)
+        results[t].push_back(
+            pool.intern("item" + std::to_string((i * 7 + t) % distinct)));
+    });
+  for (auto& thread : threads)
+    thread.join();
+  EXPECT_EQ(pool.entries(), distinct);
+  for (int t = 0; t < threadCount; ++t)
+    for (int i = 0; i < perThread; ++i)
+      ASSERT_EQ(view(header, results[t][i]),
+                "item" + std::to_string((i * 7 + t) % distinct));
+}
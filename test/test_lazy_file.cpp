@@ -0,0 +1,103 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#include <cstdint>
+#include <filesystem>
+#include <gtest/gtest.h>
+#include <nodecode/index_ptr.hpp>
+#include <nodecode/lazy_file.hpp>
+#include <nodecode/mapped_file.hpp>
+#include <numeric>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+using namespace nodecode;
+
+namespace lazy_file_test {
+
+struct Foo;
+struct Bar;
+
+struct Header {
+  lazy_section<Foo>      foos;
+  lazy_section<Bar>      bars;
+  lazy_section<uint32_t> values;
+};
+
+struct Foo {
+  int                      data;
+  index_ptr<&Header::bars> bar;
+};
+
+struct Bar {
+  int                      data;
+  index_ptr<&Header::foos> foo;
+};
+
+// Same value_types, for writing from vectors
+struct WriteHeader {
+  std::span<Foo>      foos;
+  std::span<Bar>      bars;
+  std::span<uint32_t> values;
+};
+
+std::filesystem::path writeFile(const char* name) {
+  auto                  path = std::filesystem::temp_directory_path() / name;
+  std::vector<Foo>      foos{{10, 0}, {11, 1}};
+  std::vector<Bar>      bars{{20, 1}, {21, 0}, {22, 0}};
+  std::vector<uint32_t> values(100000);
+  std::iota(values.begin(), values.end(), 0u);
+  WriteHeader header{foos, bars, values};
+  write_file<&WriteHeader::foos, &WriteHeader::bars, &WriteHeader::values>(
+      path, header);
+  return path;
+}
+
+} // namespace lazy_file_test
+
+using namespace lazy_file_test;
+
+TEST(LazyFile, MapsOnFirstBind) {
+  auto path = writeFile("nodecode_lazy_file.bin");
+  lazy_header<&Header::foos, &Header::bars, &Header::values> lazy(path);
+  EXPECT_EQ(lazy->foos.size(), 2);
+  EXPECT_EQ(lazy->bars.size(), 3);
+  EXPECT_EQ(lazy->values.size(), 100000);
+  EXPECT_FALSE(lazy->foos.mapped());
+  EXPECT_FALSE(lazy->bars.mapped());
+
+  bound_header bound(*lazy);
+  index_ptr<&Header::foos> foo(1);
+  EXPECT_EQ(foo->data, 11);
+  EXPECT_TRUE(lazy->foos.mapped());
+  EXPECT_FALSE(lazy->bars.mapped());
+  EXPECT_EQ(foo->bar->foo->data, 10);
+  EXPECT_TRUE(lazy->bars.mapped());
+  EXPECT_FALSE(lazy->values.mapped());
+
+  lazy->values.willneed(1000, 50000);
+  EXPECT_EQ(std::accumulate(lazy->values.begin(), lazy->values.end(),
+                            uint64_t(0)),
+            uint64_t(99999) * 100000 / 2);
+  // Private mapping; the file is unchanged
+  lazy->values[5] = 0;
+  lazy_header<&Header::foos, &Header::bars, &Header::values> other(
+      path, access_advice::random);
+  EXPECT_EQ(other->values[5], 5);
+  std::filesystem::remove(path);
+}
+
+TEST(LazyFile, Errors) {
+  auto path = writeFile("nodecode_lazy_file_errors.bin");
+  EXPECT_THROW((lazy_header<&Header::values, &Header::bars, &Header::foos>(
+                   path)),
+               std::runtime_error);
+  std::filesystem::resize_file(path, 64);
+  EXPECT_THROW((lazy_header<&Header::foos, &Header::bars, &Header::values>(
+                   path)),
+               std::runtime_error);
+  std::filesystem::remove(path);
+  EXPECT_THROW((lazy_header<&Header::foos, &Header::bars, &Header::values>(
+                   path)),
+               std::runtime_error);
+}
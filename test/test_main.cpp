@@ -1,5 +1,6 @@
 // Copyright (c) 2024 Pyarelal Knowles, MIT License
 
+#include <array>
 #include <bitset>
 #include <gtest/gtest.h>
 #include <nodecode/index_ptr.hpp>
@@ -249,6 +250,116 @@ TEST(IndexPtr, Chain) {
   EXPECT_EQ(header.foos[0].bar->foo->bar->foo->data, "foo0");
 }
 
+TEST(BoundView, Read) {
+  index_ptr<&StringHeader::base>  ptr(4);
+  StringHeader                    header;
+  bound_view<&StringHeader::base> view(header);
+  EXPECT_EQ(view.bind(ptr), header.base.begin() + 4);
+  EXPECT_EQ(view[ptr], 'o');
+  view[ptr] = 'O';
+  EXPECT_EQ(header.base, "hellO world");
+}
+
+TEST(BoundView, Unbound) {
+  // A view never consults bound_header
+  index_ptr<&ArrayHeader::base> ptr(6);
+  ArrayHeader                   header;
+  bound_view<&ArrayHeader::base> view(header);
+  EXPECT_THROW({ bound_header<ArrayHeader>::get(); }, std::runtime_error);
+  EXPECT_EQ(view[ptr], 'w');
+}
+
+TEST(BoundView, Span) {
+  index_span<&StringHeader::base> world(6, 5);
+  StringHeader                    header;
+  bound_view<&StringHeader::base> view(header);
+  EXPECT_EQ(view[world].data(), header.base.data() + 6);
+  EXPECT_EQ(view[world].size(), 5);
+  EXPECT_TRUE(std::ranges::equal(view[world], std::string("world")));
+}
+
+TEST(BoundView, Chain) {
+  struct Foo;
+  struct Bar;
+
+  struct Header {
+    std::span<Foo> foos;
+    std::span<Bar> bars;
+  };
+
+  struct Foo {
+    std::string              data;
+    index_ptr<&Header::bars> bar;
+  };
+
+  struct Bar {
+    std::string              data;
+    index_ptr<&Header::foos> foo;
+  };
+
+  std::vector<Foo> foos{
+      {"foo0", 0},
+      {"foo1", 1}
+  };
+  std::vector<Bar> bars{
+      {"bar0", 1},
+      {"bar1", 0}
+  };
+  Header header{foos, bars};
+
+  bound_view<&Header::foos, &Header::bars> view(header);
+  EXPECT_EQ(view[header.foos[0].bar].data, "bar0");
+  EXPECT_EQ(view[view[header.foos[0].bar].foo].data, "foo1");
+  EXPECT_EQ(view.bind(view.bind(view.bind(header.foos[0].bar)->foo)->bar)->data,
+            "bar1");
+  EXPECT_EQ(view[view[view[view[header.foos[0].bar].foo].bar].foo].data,
+            "foo0");
+}
+
+struct StaticFifths {
+  struct Key;
+  std::span<const Key> keys;
+  index_span<&StaticFifths::keys, uint8_t, true> majors;
+
+  struct Key {
+    uint8_t                                      note;
+    index_ptr<&StaticFifths::keys, uint8_t, true> next;
+  };
+};
+
+// Built entirely at compile time
+constexpr std::array<StaticFifths::Key, 12> makeFifths() {
+  std::array<StaticFifths::Key, 12> keys{};
+  for (uint8_t i = 0; i < 12; ++i)
+    keys[i] = {i, uint8_t((i + 7) % 12)};
+  return keys;
+}
+constexpr auto         staticFifthsKeys = makeFifths();
+constexpr StaticFifths staticFifths{staticFifthsKeys, {3, 4}};
+
+constexpr uint8_t walkFifths(uint8_t from, int steps) {
+  static_view<staticFifths> view;
+  index_ptr<&StaticFifths::keys, uint8_t, true> key = from;
+  for (int i = 0; i < steps; ++i)
+    key = view[key].next;
+  return view[key].note;
+}
+
+static_assert(walkFifths(0, 1) == 7);
+static_assert(walkFifths(0, 12) == 0);
+static_assert(static_view<staticFifths>()[staticFifths.majors][3].note == 6);
+
+TEST(StaticView, Read) {
+  static_view<staticFifths> view;
+  EXPECT_EQ(&view.header(), &staticFifths);
+  EXPECT_EQ(&*view.bind(staticFifths.keys[0].next), &staticFifthsKeys[7]);
+  std::vector<uint8_t> notes;
+  for (auto& key : view[staticFifths.majors])
+    notes.push_back(view[key.next].note);
+  EXPECT_EQ(notes, (std::vector<uint8_t>{10, 11, 0, 1}));
+  EXPECT_EQ(walkFifths(5, 3), 2);
+}
+
 TEST(Span, ConstructDefault) {
   index_span<&ArrayHeader::base> hello;
   EXPECT_EQ(hello.index(), 0);
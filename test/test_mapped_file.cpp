@@ -0,0 +1,146 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <nodecode/index_ptr.hpp>
+#include <nodecode/mapped_file.hpp>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+using namespace nodecode;
+
+namespace mapped_file_test {
+
+struct Foo;
+struct Bar;
+
+struct Header {
+  std::span<Foo>      foos;
+  std::span<Bar>      bars;
+  std::span<uint16_t> shorts;
+};
+
+struct Foo {
+  int                      data;
+  index_ptr<&Header::bars> bar;
+};
+
+struct Bar {
+  int                      data;
+  index_ptr<&Header::foos> foo;
+};
+
+std::filesystem::path tempPath(const char* name) {
+  return std::filesystem::temp_directory_path() / name;
+}
+
+void writeChain(const std::filesystem::path& path) {
+  std::vector<Foo>      foos{{10, 0}, {11, 1}};
+  std::vector<Bar>      bars{{20, 1}, {21, 0}, {22, 0}};
+  std::vector<uint16_t> shorts{1, 2, 3};
+  Header                header{foos, bars, shorts};
+  write_file<&Header::foos, &Header::bars, &Header::shorts>(path, header);
+}
+
+} // namespace mapped_file_test
+
+using namespace mapped_file_test;
+
+TEST(MappedFile, Layout) {
+  auto layout = file_layout::make<&Header::foos, &Header::bars>({3, 5});
+  EXPECT_EQ(layout.header.section_count, 2);
+  ASSERT_EQ(layout.sections.size(), 2);
+  EXPECT_EQ(layout.sections[0].offset % file_section_alignment, 0);
+  EXPECT_EQ(layout.sections[1].offset % file_section_alignment, 0);
+  EXPECT_GE(layout.sections[1].offset,
+            layout.sections[0].offset + 3 * sizeof(Foo));
+  EXPECT_EQ(layout.sections[1].element_size, sizeof(Bar));
+  EXPECT_EQ(layout.header.file_size,
+            layout.sections[1].offset + 5 * sizeof(Bar));
+}
+
+TEST(MappedFile, RoundTrip) {
+  auto path = tempPath("nodecode_mapped_file_roundtrip.bin");
+  writeChain(path);
+  auto layout =
+      file_layout::make<&Header::foos, &Header::bars, &Header::shorts>(
+          {2, 3, 3});
+  EXPECT_EQ(std::filesystem::file_size(path), layout.header.file_size);
+
+  mapped_header<&Header::foos, &Header::bars, &Header::shorts> mapped(path);
+  ASSERT_EQ(mapped->foos.size(), 2);
+  ASSERT_EQ(mapped->bars.size(), 3);
+  ASSERT_EQ(mapped->shorts.size(), 3);
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(mapped->bars.data()) %
+                file_section_alignment,
+            0);
+  EXPECT_EQ(mapped->shorts[2], 3);
+
+  bound_header bound(*mapped);
+  EXPECT_EQ(mapped->foos[0].data, 10);
+  EXPECT_EQ(mapped->foos[0].bar->data, 20);
+  EXPECT_EQ(mapped->foos[0].bar->foo->data, 11);
+  EXPECT_EQ(mapped->foos[0].bar->foo->bar->data, 21);
+  EXPECT_EQ(mapped->foos[0].bar->foo->bar->foo->data, 10);
+
+  // Private mapping: writes are visible but never reach the file
+  mapped->foos[0].data = 42;
+  EXPECT_EQ(mapped->bars[1].foo->data, 42);
+  mapped_header<&Header::foos, &Header::bars, &Header::shorts> fresh(path);
+  EXPECT_EQ(fresh->foos[0].data, 10);
+  std::filesystem::remove(path);
+}
+
+TEST(MappedFile, Empty) {
+  auto                  path = tempPath("nodecode_mapped_file_empty.bin");
+  Header                header;
+  write_file<&Header::foos, &Header::bars, &Header::shorts>(path, header);
+  mapped_header<&Header::foos, &Header::bars, &Header::shorts> mapped(path);
+  EXPECT_TRUE(mapped->foos.empty());
+  EXPECT_TRUE(mapped->bars.empty());
+  EXPECT_TRUE(mapped->shorts.empty());
+  std::filesystem::remove(path);
+}
+
+TEST(MappedFile, Missing) {
+  EXPECT_THROW((mapped_header<&Header::foos, &Header::bars>(
+                   tempPath("nodecode_mapped_file_missing.bin"))),
+               std::runtime_error);
+}
+
+TEST(MappedFile, BadMagic) {
+  auto path = tempPath("nodecode_mapped_file_magic.bin");
+  writeChain(path);
+  {
+    std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+    file.write("x", 1);
+  }
+  EXPECT_THROW((mapped_header<&Header::foos, &Header::bars, &Header::shorts>(
+                   path)),
+               std::runtime_error);
+  std::filesystem::remove(path);
+}
+
+TEST(MappedFile, WrongSections) {
+  auto path = tempPath("nodecode_mapped_file_sections.bin");
+  writeChain(path);
+  EXPECT_THROW((mapped_header<&Header::foos, &Header::bars>(path)),
+               std::runtime_error);
+  EXPECT_THROW((mapped_header<&Header::foos, &Header::shorts, &Header::bars>(
+                   path)),
+               std::runtime_error);
+  std::filesystem::remove(path);
+}
+
+TEST(MappedFile, Truncated) {
+  auto path = tempPath("nodecode_mapped_file_truncated.bin");
+  writeChain(path);
+  std::filesystem::resize_file(path, std::filesystem::file_size(path) - 1);
+  EXPECT_THROW((mapped_header<&Header::foos, &Header::bars, &Header::shorts>(
+                   path)),
+               std::runtime_error);
+  std::filesystem::remove(path);
+}
@@ -0,0 +1,158 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#include <algorithm>
+#include <cstdint>
+#include <gtest/gtest.h>
+#include <nodecode/index_ptr.hpp>
+#include <nodecode/packed_index_array.hpp>
+#include <ranges>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace nodecode;
+
+namespace packed_index_array_test {
+
+struct Header {
+  std::string           chars = "hello world";
+  std::vector<uint32_t> values;
+  std::vector<uint64_t> wide;
+};
+
+template <class Array>
+std::vector<uint64_t> fill(Array& array, size_t size) {
+  std::vector<uint64_t> expected;
+  for (size_t i = 0; i < size; ++i) {
+    auto index = (uint64_t(i) * 0x9e3779b97f4a7c15ull) & Array::mask;
+    expected.push_back(index);
+    array.push_back(typename Array::index_type(index));
+  }
+  return expected;
+}
+
+} // namespace packed_index_array_test
+
+using namespace packed_index_array_test;
+
+static_assert(std::random_access_iterator<
+              packed_index_array<&Header::chars, 5>::const_iterator>);
+static_assert(std::ranges::random_access_range<
+              const packed_index_array<&Header::chars, 5>>);
+
+TEST(PackedIndexArray, Deref) {
+  Header header;
+  packed_index_array<&Header::chars, 4> array;
+  array.push_back(4);
+  array.push_back(6);
+  array.push_back(10);
+  EXPECT_EQ(array.size(), 3);
+  EXPECT_EQ(*array[0].bind(header), 'o');
+  bound_header bound(header);
+  EXPECT_EQ(*array[1], 'w');
+  index_ptr<&Header::chars> ptr = array[2];
+  EXPECT_EQ(*ptr, 'd');
+  EXPECT_EQ(index_ptr<&Header::chars>(std::as_const(array)[1]), 6);
+}
+
+TEST(PackedIndexArray, Assign) {
+  packed_index_array<&Header::chars, 4> array(3);
+  array[0] = 4;
+  array[1] = 15;
+  array[2] = array[0];
+  EXPECT_EQ(array.get(0), 4);
+  EXPECT_EQ(array.get(1), 15);
+  EXPECT_EQ(array.get(2), 4);
+  EXPECT_THROW(array[1] = 16, std::out_of_range);
+  EXPECT_EQ(array.get(1), 15);
+}
+
+TEST(PackedIndexArray, Widths) {
+  // Every width straddles word boundaries differently
+  auto test = [](auto array) {
+    auto expected = fill(array, 1000);
+    for (size_t i = 0; i < expected.size(); ++i)
+      ASSERT_EQ(array.get(i), expected[i]) << "bits " << array.bits;
+    // Overwriting one element leaves its neighbours alone
+    array.set(500, 0);
+    ASSERT_EQ(array.get(499), expected[499]);
+    ASSERT_EQ(array.get(500), 0);
+    ASSERT_EQ(array.get(501), expected[501]);
+  };
+  test(packed_index_array<&Header::values, 1>());
+  test(packed_index_array<&Header::values, 7>());
+  test(packed_index_array<&Header::values, 13>());
+  test(packed_index_array<&Header::values, 20>());
+  test(packed_index_array<&Header::values, 31>());
+  test(packed_index_array<&Header::values, 32>());
+  test(packed_index_array<&Header::wide, 33, uint64_t>());
+  test(packed_index_array<&Header::wide, 64, uint64_t>());
+}
+
+TEST(PackedIndexArray, Size) {
+  packed_index_array<&Header::values, 20> array(1000);
+  // 20 bits each plus one spare word
+  EXPECT_EQ(array.words().size_bytes(), (1000 * 20 + 63) / 64 * 8 + 8);
+}
+
+TEST(PackedIndexArray, ShrinkGrow) {
+  auto test = [](auto array) {
+    auto expected = fill(array, 300);
+    for (size_t size : {size_t(250), size_t(97), size_t(1), size_t(0)}) {
+      array.resize(size);
+      array.resize(300);
+      for (size_t i = 0; i < size; ++i)
+        ASSERT_EQ(array.get(i), expected[i]) << "bits " << array.bits;
+      for (size_t i = size; i < 300; ++i)
+        ASSERT_EQ(array.get(i), 0) << "bits " << array.bits << " at " << i;
+    }
+    // push_back() grows through resize() too
+    array.resize(10);
+    array.push_back(5);
+    array.resize(12);
+    EXPECT_EQ(array.get(10), 5);
+    EXPECT_EQ(array.get(11), 0);
+  };
+  test(packed_index_array<&Header::values, 7>());
+  test(packed_index_array<&Header::values, 20>());
+  test(packed_index_array<&Header::values, 32>());
+  test(packed_index_array<&Header::wide, 64, uint64_t>());
+}
+
+TEST(PackedIndexArray, Unpack) {
+  packed_index_array<&Header::values, 20> array;
+  auto expected = fill(array, 1000);
+  // Unaligned head, whole blocks and a tail
+  for (auto [first, count] : {std::pair<size_t, size_t>{0, 1000},
+                              {3, 200},
+                              {64, 128},
+                              {990, 10},
+                              {17, 0}}) {
+    std::vector<uint32_t> out(count);
+    array.unpack(first, std::span(out));
+    for (size_t i = 0; i < count; ++i)
+      ASSERT_EQ(out[i], expected[first + i]);
+  }
+  std::vector<index_ptr<&Header::values>> ptrs(10);
+  array.unpack(std::span(ptrs));
+  EXPECT_EQ(ptrs[9], expected[9]);
+  std::vector<uint32_t> tooMany(1001);
+  EXPECT_THROW(array.unpack(std::span(tooMany)), std::out_of_range);
+}
+
+TEST(PackedIndexArray, Iterate) {
+  Header header;
+  packed_index_array<&Header::chars, 4> array(std::vector<int>{0, 1, 2, 3, 4});
+  bound_header bound(header);
+  std::string  result;
+  for (index_ptr<&Header::chars> ptr : std::as_const(array))
+    result.push_back(*ptr);
+  EXPECT_EQ(result, "hello");
+  for (auto ref : array)
+    ref = 10 - ref;
+  EXPECT_EQ(array.get(0), 10);
+  EXPECT_EQ(array.end() - array.begin(), 5);
+  EXPECT_EQ(*(array.begin() + 2), 8);
+  EXPECT_EQ(**(array.begin() + 2), 'r');
+}
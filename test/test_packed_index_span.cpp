@@ -0,0 +1,86 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#include <cstdint>
+#include <gtest/gtest.h>
+#include <nodecode/index_ptr.hpp>
+#include <nodecode/packed_index_span.hpp>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace nodecode;
+
+namespace packed_index_span_test {
+
+struct Header {
+  std::string                               chars;
+  std::vector<index_span<&Header::chars>>   long_spans;
+};
+
+using Span = packed_index_span<&Header::chars, &Header::long_spans>;
+using Tiny = packed_index_span<&Header::chars, &Header::long_spans, 4>;
+
+} // namespace packed_index_span_test
+
+using namespace packed_index_span_test;
+
+static_assert(sizeof(Span) == 4);
+static_assert(sizeof(index_span<&Header::chars, uint16_t, false, uint8_t>) == 4);
+static_assert(sizeof(index_span<&Header::chars>) == 8);
+
+TEST(IndexSpan, SizeType) {
+  Header header{"hello world", {}};
+  index_span<&Header::chars, uint16_t, false, uint8_t> world(6, 5);
+  EXPECT_EQ(world.index(), 6);
+  EXPECT_EQ(world.size(), 5);
+  bound_header bound(header);
+  EXPECT_EQ(world, std::string("world"));
+  bound_view<&Header::chars> view(header);
+  EXPECT_EQ(view[world].size(), 5);
+}
+
+TEST(PackedIndexSpan, Inline) {
+  Header header{"hello world", {}};
+  Span   world(6, 5);
+  EXPECT_TRUE(world.is_inline());
+  EXPECT_EQ(world.word(), (6u << 8) | 5u);
+  EXPECT_EQ(world.size(), 5);
+  auto span = world.unpack(header);
+  EXPECT_EQ(span.index(), 6);
+  EXPECT_EQ(span.size(), 5);
+  EXPECT_EQ(std::string(world.bind(header).begin(), world.bind(header).end()),
+            "world");
+  bound_header bound(header);
+  EXPECT_EQ(world, std::string("world"));
+  EXPECT_EQ(world[1], 'o');
+}
+
+TEST(PackedIndexSpan, Limits) {
+  EXPECT_EQ(Span::max_size, 254);
+  EXPECT_EQ(Span::max_index, (1u << 24) - 1);
+  EXPECT_TRUE(Span::fits_inline(Span::max_index, Span::max_size));
+  EXPECT_FALSE(Span::fits_inline(0, 255));
+  EXPECT_FALSE(Span::fits_inline(1u << 24, 0));
+  EXPECT_THROW(Span(0, 255), std::out_of_range);
+  EXPECT_THROW(Span(1u << 24, 1), std::out_of_range);
+}
+
+TEST(PackedIndexSpan, Overflow) {
+  Header header{"abcdefghijklmnopqrstuvwxyz", {}};
+  // At most 14 objects inline with 4 size bits
+  auto alphabet = Tiny::make(0, 26, header.long_spans);
+  auto vowels   = Tiny::make(0, 5, header.long_spans);
+  auto tail     = Tiny::make(10, 16, header.long_spans);
+  EXPECT_FALSE(alphabet.is_inline());
+  EXPECT_TRUE(vowels.is_inline());
+  EXPECT_FALSE(tail.is_inline());
+  ASSERT_EQ(header.long_spans.size(), 2);
+  EXPECT_EQ(alphabet.unpack(header).size(), 26);
+  EXPECT_EQ(tail.unpack(header).index(), 10);
+  EXPECT_EQ(tail.bind(header).size(), 16);
+  bound_header bound(header);
+  EXPECT_EQ(alphabet.size(), 26);
+  EXPECT_EQ(alphabet, header.chars);
+  EXPECT_EQ(vowels, std::string("abcde"));
+  EXPECT_EQ(tail, std::string("klmnopqrstuvwxyz"));
+}
@@ -0,0 +1,132 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <future>
+#include <gtest/gtest.h>
+#include <nodecode/index_ptr.hpp>
+#include <nodecode/parallel.hpp>
+#include <numeric>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+using namespace nodecode;
+
+namespace parallel_test {
+
+struct Header {
+  std::vector<uint32_t>                   values;
+  std::vector<index_ptr<&Header::values>> refs;
+  index_span<&Header::refs>               someRefs;
+};
+
+Header make_header(size_t size) {
+  Header header;
+  for (size_t i = 0; i < size; ++i) {
+    header.values.push_back(uint32_t(i));
+    header.refs.push_back(uint32_t((i * 7919) % size));
+  }
+  header.someRefs = {10, uint32_t(size - 20)};
+  return header;
+}
+
+} // namespace parallel_test
+
+using namespace parallel_test;
+
+TEST(Parallel, ForEach) {
+  Header                header = make_header(100000);
+  std::atomic<uint64_t> sum    = 0;
+  // Dereferencing in workers needs the binding
+  parallel_for_each(header, header.refs,
+                    [&](auto& ref) { sum += *ref; }, 1000, 4);
+  EXPECT_EQ(sum, std::accumulate(header.values.begin(), header.values.end(),
+                                 uint64_t(0)));
+}
+
+TEST(Parallel, ForEachSpan) {
+  Header                header = make_header(1000);
+  std::atomic<uint64_t> sum    = 0;
+  parallel_for_each(header, header.someRefs,
+                    [&](auto& ref) { sum += *ref; }, 7, 3);
+  uint64_t expected = 0;
+  for (size_t i = 10; i < 990; ++i)
+    expected += header.values[header.refs[i]];
+  EXPECT_EQ(sum, expected);
+}
+
+TEST(Parallel, ForEachWrite) {
+  Header header = make_header(10000);
+  parallel_for_each(header, header.values, [](uint32_t& v) { v *= 2; }, 100);
+  for (size_t i = 0; i < header.values.size(); ++i)
+    EXPECT_EQ(header.values[i], i * 2);
+}
+
+TEST(Parallel, ForEachEmpty) {
+  Header header;
+  parallel_for_each(header, header.refs, [](auto&) { FAIL(); });
+}
+
+TEST(Parallel, ForEachThrows) {
+  Header header = make_header(10000);
+  EXPECT_THROW(parallel_for_each(
+                   header, header.refs,
+                   [](auto& ref) {
+                     if (*ref == 5000)
+                       throw std::runtime_error("stop");
+                   },
+                   10, 4),
+               std::runtime_error);
+  // Bindings are unwound in every thread
+  EXPECT_THROW({ bound_header<Header>::get(); }, std::runtime_error);
+}
+
+TEST(Parallel, BoundTask) {
+  Header header = make_header(10);
+  std::function<uint32_t(size_t)> task;
+  {
+    bound_header bound(header);
+    task = bound_task<Header>(
+        [&](size_t i) -> uint32_t { return *header.refs[i]; });
+  }
+  EXPECT_THROW({ bound_header<Header>::get(); }, std::runtime_error);
+  auto future = std::async(std::launch::async, task, 3);
+  EXPECT_EQ(future.get(), header.values[header.refs[3]]);
+  std::thread([&] { EXPECT_EQ(task(4), header.values[header.refs[4]]); }).join();
+  EXPECT_THROW({ bound_header<Header>::get(); }, std::runtime_error);
+}
+
+TEST(Parallel, RadixPartition) {
+  Header header    = make_header(10000);
+  size_t chunkSize = 333;
+  size_t chunks    = (header.refs.size() + chunkSize - 1) / chunkSize;
+  auto   forChunk  = [&](size_t chunk, auto&& fn) {
+    size_t end = std::min((chunk + 1) * chunkSize, header.refs.size());
+    for (size_t i = chunk * chunkSize; i < end; ++i)
+      fn(i, header.refs[i] % 7);
+  };
+  radix_partition partition(
+      header, chunks, 7,
+      [&](size_t chunk, auto&& add) {
+        forChunk(chunk, [&](size_t, size_t bucket) { add(bucket); });
+      },
+      4);
+  ASSERT_EQ(partition.size(), header.refs.size());
+  std::vector<size_t> partitioned(partition.size());
+  partition.scatter(header, [&](size_t chunk, auto&& next) {
+    forChunk(chunk,
+             [&](size_t i, size_t bucket) { partitioned[next(bucket)] = i; });
+  });
+  // Grouped by bucket, in the original order within each
+  for (size_t b = 0; b < partition.buckets(); ++b) {
+    for (size_t k = partition.begin(b); k < partition.end(b); ++k) {
+      EXPECT_EQ(header.refs[partitioned[k]] % 7, b);
+      if (k > partition.begin(b)) {
+        EXPECT_LT(partitioned[k - 1], partitioned[k]);
+      }
+    }
+  }
+  EXPECT_EQ(partition.end(6), partition.size());
+}
@@ -0,0 +1,92 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#include <cstdint>
+#include <gtest/gtest.h>
+#include <nodecode/gather.hpp>
+#include <nodecode/index_ptr.hpp>
+#include <nodecode/partitioned_gather.hpp>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+using namespace nodecode;
+
+namespace partitioned_gather_test {
+
+struct Header {
+  std::vector<uint32_t>                  u32;
+  std::vector<uint64_t>                  u64;
+  std::vector<index_ptr<&Header::u32>>   ptrs32;
+  std::vector<index_ptr<&Header::u64>>   ptrs64;
+};
+
+Header make_header(size_t objects, size_t requests) {
+  Header       header;
+  std::mt19937 gen(7);
+  for (size_t i = 0; i < objects; ++i) {
+    header.u32.push_back(uint32_t(gen()));
+    header.u64.push_back(uint64_t(gen()) << 32 | i);
+  }
+  for (size_t i = 0; i < requests; ++i) {
+    header.ptrs32.push_back(uint32_t(gen() % objects));
+    header.ptrs64.push_back(uint32_t(gen() % objects));
+  }
+  return header;
+}
+
+} // namespace partitioned_gather_test
+
+using namespace partitioned_gather_test;
+
+TEST(PartitionedGather, MatchesGather) {
+  Header header = make_header(100003, 250001);
+  // Small regions force many partitions and chunks
+  for (size_t regionBytes : {size_t(64), size_t(4096), default_partition_bytes}) {
+    for (size_t threads : {1, 4}) {
+      std::vector<uint32_t> expected32(header.ptrs32.size()),
+          actual32(header.ptrs32.size());
+      gather(header.ptrs32, header, expected32);
+      partitioned_gather(header.ptrs32, header, actual32, regionBytes, threads);
+      EXPECT_EQ(actual32, expected32);
+
+      std::vector<uint64_t> expected64(header.ptrs64.size()),
+          actual64(header.ptrs64.size());
+      gather(header.ptrs64, header, expected64);
+      partitioned_gather(header.ptrs64, header, actual64, regionBytes, threads);
+      EXPECT_EQ(actual64, expected64);
+    }
+  }
+}
+
+TEST(PartitionedGather, Edges) {
+  Header                header = make_header(1000, 10);
+  std::vector<uint32_t> out(10), expected(10);
+  gather(header.ptrs32, header, expected);
+  partitioned_gather(header.ptrs32, header, out, 16);
+  EXPECT_EQ(out, expected);
+
+  std::vector<uint32_t> small(9);
+  EXPECT_THROW(partitioned_gather(header.ptrs32, header, small, 16),
+               std::out_of_range);
+  header.ptrs32.clear();
+  partitioned_gather(header.ptrs32, header, small, 16);
+}
+
+TEST(PartitionedGather, OutOfRange) {
+  Header                header = make_header(100003, 50000);
+  std::vector<uint32_t> out(header.ptrs32.size());
+  // Past the array but within the last region, and far past every region
+  for (uint32_t bad : {100003u, 100003u + 5000u, 0xffffffffu}) {
+    header.ptrs32[25000] = bad;
+    for (size_t threads : {1, 4})
+      EXPECT_THROW(partitioned_gather(header.ptrs32, header, out, 4096, threads),
+                   std::out_of_range);
+  }
+  // Arrays too small to partition go to gather() and are checked too
+  Header small    = make_header(1000, 10);
+  small.ptrs32[5] = 1000;
+  std::vector<uint32_t> smallOut(10, 7);
+  EXPECT_THROW(partitioned_gather(small.ptrs32, small, smallOut),
+               std::out_of_range);
+  EXPECT_EQ(smallOut, std::vector<uint32_t>(10, 7));
+}
@@ -0,0 +1,144 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#include <algorithm>
+#include <cstdint>
+#include <gtest/gtest.h>
+#include <nodecode/index_ptr.hpp>
+#include <nodecode/prefetch.hpp>
+#include <numeric>
+#include <ranges>
+#include <span>
+#include <string>
+#include <vector>
+
+using namespace nodecode;
+
+namespace prefetch_test {
+
+struct Header {
+  std::vector<uint32_t>                     values;
+  std::vector<index_ptr<&Header::values>>   refs;
+  std::string                               chars;
+};
+
+Header make_header(size_t size, size_t refs) {
+  Header header;
+  for (size_t i = 0; i < size; ++i) {
+    header.values.push_back(uint32_t(i * 3 + 1));
+    header.chars.push_back(char('a' + i % 26));
+  }
+  for (size_t i = 0; i < refs; ++i)
+    header.refs.push_back(uint32_t((i * 7919 + 13) % size));
+  return header;
+}
+
+// Records the targets prefetch_view prefetches, through the prefetch()
+// overload it finds by argument dependent lookup
+struct Traced {
+  uint32_t value;
+};
+
+struct TracedHeader {
+  std::vector<Traced>                            objects;
+  std::vector<index_ptr<&TracedHeader::objects>> refs;
+};
+
+std::vector<const Traced*> prefetched;
+
+void prefetch(const Traced* object) { prefetched.push_back(object); }
+
+} // namespace prefetch_test
+
+using namespace prefetch_test;
+
+static_assert(std::ranges::forward_range<
+              prefetch_view<std::vector<index_ptr<&Header::values>>>>);
+static_assert(std::ranges::view<
+              prefetch_view<std::vector<index_ptr<&Header::values>>>>);
+
+TEST(Prefetch, Iterate) {
+  Header header = make_header(101, 37);
+  std::vector<uint32_t> expected;
+  for (auto& ref : header.refs)
+    expected.push_back(header.values[ref]);
+  // Distances shorter, equal and longer than the range
+  for (size_t distance : {0, 1, 16, 37, 100}) {
+    prefetch_view view(header.refs, header, distance);
+    EXPECT_EQ(view.size(), header.refs.size());
+    EXPECT_EQ(view.distance(), distance);
+    EXPECT_TRUE(std::ranges::equal(view, expected));
+  }
+}
+
+TEST(Prefetch, PrefetchOrder) {
+  TracedHeader header;
+  for (uint32_t i = 0; i < 20; ++i) {
+    header.objects.push_back({i});
+    header.refs.push_back(i);
+  }
+  for (size_t distance : {0, 1, 4, 19, 20, 30}) {
+    prefetched.clear();
+    size_t i = 0;
+    for (const Traced& object : prefetch_view(header.refs, header, distance)) {
+      EXPECT_EQ(object.value, i);
+      // Targets up to distance elements ahead are prefetched, once each
+      EXPECT_EQ(prefetched.size(), distance ? std::min(i + distance, size_t(20)) : 0);
+      ++i;
+    }
+    std::vector<uint32_t> expected(distance ? 20 : 0);
+    std::iota(expected.begin(), expected.end(), 0u);
+    std::vector<uint32_t> indices;
+    for (const Traced* object : prefetched)
+      indices.push_back(uint32_t(object - header.objects.data()));
+    EXPECT_EQ(indices, expected);
+  }
+}
+
+TEST(Prefetch, Write) {
+  Header header = make_header(10, 10);
+  for (auto& value : prefetch_view(header.refs, header))
+    value = 0;
+  for (auto& ref : header.refs)
+    EXPECT_EQ(header.values[ref], 0u);
+}
+
+TEST(Prefetch, Pointer) {
+  Header header = make_header(10, 5);
+  prefetch_view view(header.refs, header);
+  auto it = view.begin();
+  ++it;
+  EXPECT_EQ(&it.pointer(), &header.refs[1]);
+  EXPECT_EQ(*it++, header.values[header.refs[1]]);
+  EXPECT_EQ(&it.pointer(), &header.refs[2]);
+}
+
+TEST(Prefetch, SetDistance) {
+  Header header = make_header(10, 5);
+  prefetch_view view(header.refs, header);
+  EXPECT_EQ(view.distance(), default_prefetch_distance);
+  view.set_distance(2);
+  EXPECT_EQ(view.distance(), 2);
+  EXPECT_EQ(std::accumulate(view.begin(), view.end(), 0u),
+            std::accumulate(header.refs.begin(), header.refs.end(), 0u,
+                            [&](uint32_t sum, auto& ref) {
+                              return sum + header.values[ref];
+                            }));
+}
+
+TEST(Prefetch, Span) {
+  struct SpanHeader {
+    std::string                                    chars = "hello world";
+    std::vector<index_ptr<&SpanHeader::chars>>     refs  = {4, 6, 0};
+  } header;
+  std::string result;
+  for (char c : prefetch_view(std::span(header.refs), header))
+    result.push_back(c);
+  EXPECT_EQ(result, "owh");
+}
+
+TEST(Prefetch, Empty) {
+  Header header = make_header(10, 0);
+  prefetch_view view(header.refs, header);
+  EXPECT_EQ(view.begin(), view.end());
+  EXPECT_TRUE(view.empty());
+}
@@ -0,0 +1,152 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#include <cstdint>
+#include <gtest/gtest.h>
+#include <nodecode/index_ptr.hpp>
+#include <nodecode/relayout.hpp>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace nodecode;
+
+namespace relayout_test {
+
+struct Foo;
+struct Bar;
+
+struct Header {
+  std::vector<Foo>                     foos;
+  std::vector<Bar>                     bars;
+  std::vector<index_ptr<&Header::foos>> roots;
+};
+
+struct Foo {
+  std::string               data;
+  index_ptr<&Header::bars>  bar;
+  index_ptr<&Header::foos>  next;
+};
+
+struct Bar {
+  std::string                data;
+  index_ptr<&Header::foos>   foo;
+  index_span<&Header::foos>  children;
+};
+
+Header make_header() {
+  Header header;
+  for (int i = 0; i < 6; ++i)
+    header.foos.push_back({"foo" + std::to_string(i), uint32_t(i % 2),
+                           uint32_t((i + 1) % 6)});
+  header.bars = {
+      {"bar0", 5, {0, 2}},
+      {"bar1", 3, {4, 2}},
+  };
+  header.roots = {0, 3};
+  return header;
+}
+
+using Refs = std::tuple<index_refs<&Header::foos, &Foo::next>,
+                        index_refs<&Header::bars, &Bar::foo>,
+                        index_refs<&Header::bars, &Bar::children>,
+                        index_refs<&Header::roots>>;
+
+// Every reference into foos, to check a failed relayout changed nothing
+std::vector<uint32_t> foo_refs(const Header& header) {
+  std::vector<uint32_t> result;
+  for (auto& foo : header.foos)
+    result.push_back(foo.next);
+  for (auto& bar : header.bars) {
+    result.push_back(bar.foo);
+    result.push_back(bar.children.index());
+    result.push_back(bar.children.size());
+  }
+  for (auto& root : header.roots)
+    result.push_back(root);
+  return result;
+}
+
+template <class... R>
+void relayout_foos(Header& header, const std::vector<size_t>& order,
+                   std::tuple<R...>) {
+  relayout<&Header::foos, R...>(header, order, 2, 3);
+}
+
+} // namespace relayout_test
+
+using namespace relayout_test;
+
+TEST(Relayout, Permute) {
+  Header header = make_header();
+  // Keeps both children spans contiguous: {0, 1} -> {4, 5}, {4, 5} -> {0, 1}
+  relayout_foos(header, {4, 5, 3, 2, 0, 1}, Refs{});
+  EXPECT_EQ(header.foos[0].data, "foo4");
+  EXPECT_EQ(header.foos[3].data, "foo2");
+  bound_header bound(header);
+  EXPECT_EQ(header.roots[0]->data, "foo0");
+  EXPECT_EQ(header.roots[1]->data, "foo3");
+  EXPECT_EQ(header.bars[0].foo->data, "foo5");
+  EXPECT_EQ(header.bars[0].children.index(), 4);
+  EXPECT_EQ(header.bars[0].children[1].data, "foo1");
+  EXPECT_EQ(header.bars[1].children[0].data, "foo4");
+  // The cycle through next is unchanged
+  std::string walk;
+  auto        foo = header.roots[0];
+  for (int i = 0; i < 6; ++i, foo = foo->next)
+    walk += foo->data.back();
+  EXPECT_EQ(walk, "012345");
+  EXPECT_EQ(header.foos[0].bar->data, "bar0");
+}
+
+TEST(Relayout, BadOrder) {
+  Header header = make_header();
+  EXPECT_THROW(relayout_foos(header, {0, 1, 2}, Refs{}), std::invalid_argument);
+  EXPECT_THROW(relayout_foos(header, {0, 1, 2, 3, 4, 4}, Refs{}),
+               std::invalid_argument);
+  EXPECT_THROW(relayout_foos(header, {0, 1, 2, 3, 4, 6}, Refs{}),
+               std::invalid_argument);
+  EXPECT_EQ(header.foos[5].data, "foo5");
+}
+
+TEST(Relayout, SplitSpan) {
+  Header header = make_header();
+  auto   before = foo_refs(header);
+  EXPECT_THROW(relayout_foos(header, {1, 0, 2, 3, 4, 5}, Refs{}),
+               std::invalid_argument);
+  // Foo::next and Bar::foo come before the split span in Refs and must not
+  // have been rewritten
+  EXPECT_EQ(foo_refs(header), before);
+  EXPECT_EQ(header.foos[0].data, "foo0");
+}
+
+TEST(Relayout, OutOfRange) {
+  Header header = make_header();
+  header.roots.push_back(6);
+  auto before = foo_refs(header);
+  EXPECT_THROW(relayout_foos(header, {4, 5, 3, 2, 0, 1}, Refs{}),
+               std::out_of_range);
+  EXPECT_EQ(foo_refs(header), before);
+  EXPECT_EQ(header.foos[0].data, "foo0");
+}
+
+TEST(Relayout, Bfs) {
+  Header header = make_header();
+  auto   order  = bfs_order(header.foos.size(), std::vector<size_t>{3},
+                            [&](size_t i) {
+                              return std::vector<size_t>{header.foos[i].next};
+                            });
+  EXPECT_EQ(order, (std::vector<size_t>{3, 4, 5, 0, 1, 2}));
+  relayout<&Header::foos, index_refs<&Header::foos, &Foo::next>>(header,
+                                                                  order);
+  for (size_t i = 0; i < header.foos.size(); ++i)
+    EXPECT_EQ(header.foos[i].next, (i + 1) % header.foos.size());
+  EXPECT_EQ(header.foos[0].data, "foo3");
+}
+
+TEST(Relayout, BfsUnreached) {
+  auto order = bfs_order(5, std::vector<int>{2}, [](size_t i) {
+    return i == 2 ? std::vector<size_t>{4} : std::vector<size_t>{};
+  });
+  EXPECT_EQ(order, (std::vector<size_t>{2, 4, 0, 1, 3}));
+}
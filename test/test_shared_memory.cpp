@@ -0,0 +1,162 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#include <cstdint>
+#include <gtest/gtest.h>
+#include <new>
+#include <nodecode/index_ptr.hpp>
+#include <nodecode/shared_memory.hpp>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace nodecode;
+
+namespace shared_memory_test {
+
+struct Foo;
+struct Bar;
+
+struct Header {
+  std::span<Foo> foos;
+  std::span<Bar> bars;
+};
+
+struct Foo {
+  int                      data;
+  index_ptr<&Header::bars> bar;
+};
+
+struct Bar {
+  int                      data;
+  index_ptr<&Header::foos> foo;
+};
+
+using shared_type = shared_header<&Header::foos, &Header::bars>;
+
+shared_segment makeChain(const std::string& name,
+                         std::array<uint64_t, 2> capacities = {}) {
+  std::vector<Foo> foos{{10, 0}, {11, 1}};
+  std::vector<Bar> bars{{20, 1}, {21, 0}, {22, 0}};
+  Header           header{foos, bars};
+  return make_shared_segment<&Header::foos, &Header::bars>(name, header,
+                                                           capacities);
+}
+
+std::string uniqueName(const char* name) {
+  return "/nodecode_test_" + std::string(name) + "_" +
+         std::to_string(::getpid());
+}
+
+// Runs fn in a child process and returns its exit status
+template <class Fn>
+int inChild(Fn&& fn) {
+  pid_t pid = ::fork();
+  if (pid == 0)
+    ::_exit(fn());
+  int status = 0;
+  ::waitpid(pid, &status, 0);
+  return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+} // namespace shared_memory_test
+
+using namespace shared_memory_test;
+
+TEST(SharedMemory, Anonymous) {
+  shared_type  shared(makeChain(""));
+  bound_header bound(*shared);
+  ASSERT_EQ(shared->foos.size(), 2);
+  ASSERT_EQ(shared->bars.size(), 3);
+  EXPECT_EQ(shared->foos[0].bar->foo->data, 11);
+
+  // A second mapping of the same memory is at a different address
+  shared_type other(shared_segment::attach(shared.segment().fd(),
+                                           shared_access::read_write));
+  EXPECT_NE(other->foos.data(), shared->foos.data());
+  other->foos[1].data = 42;
+  EXPECT_EQ(shared->bars[0].foo->data, 42);
+}
+
+TEST(SharedMemory, OtherProcess) {
+  auto name = uniqueName("other_process");
+  shared_type shared(makeChain(name));
+  int status = inChild([&] {
+    shared_type  child(shared_segment::open(name, shared_access::read_only));
+    bound_header bound(*child);
+    return child->bars[1].foo->bar->data == 20 ? 0 : 1;
+  });
+  EXPECT_EQ(status, 0);
+  shared_segment::unlink(name);
+  EXPECT_THROW(shared_segment::open(name, shared_access::read_only),
+               std::runtime_error);
+}
+
+TEST(SharedMemory, Allocate) {
+  auto        name = uniqueName("allocate");
+  shared_type shared(makeChain(name, {4, 100}));
+  shared_segment::unlink(name);
+  // Capacity may include the padding up to the next section
+  size_t capacity = shared.capacity<&Header::foos>();
+  EXPECT_GE(capacity, 4);
+  EXPECT_GE(shared.capacity<&Header::bars>(), 100);
+
+  // A child process appends, the parent sees it after refresh()
+  int status = inChild([&] {
+    shared_type child(shared_segment::attach(shared.segment().fd(),
+                                             shared_access::read_write));
+    auto        allocation = child.allocate<&Header::foos>(2);
+    if (allocation.index != 2)
+      return 1;
+    allocation.objects[0] = {12, 2};
+    allocation.objects[1] = {13, 0};
+    child.commit<&Header::foos>(allocation);
+    return 0;
+  });
+  EXPECT_EQ(status, 0);
+  EXPECT_EQ(shared->foos.size(), 2);
+  shared.refresh();
+  bound_header bound(*shared);
+  ASSERT_EQ(shared->foos.size(), 4);
+  EXPECT_EQ(shared->foos[2].bar->data, 22);
+  EXPECT_EQ(shared->foos[3].data, 13);
+  EXPECT_THROW(shared.allocate<&Header::foos>(capacity - 3), std::bad_alloc);
+  EXPECT_EQ(shared.allocate<&Header::foos>(capacity - 4).index, 4);
+
+  shared_type readOnly(shared_segment::attach(shared.segment().fd(),
+                                              shared_access::read_only));
+  EXPECT_THROW(readOnly.allocate<&Header::bars>(1), std::logic_error);
+}
+
+TEST(SharedMemory, Commit) {
+  shared_type shared(makeChain("", {8, 0}));
+  shared_type reader(shared_segment::attach(shared.segment().fd(),
+                                            shared_access::read_only));
+  auto        first  = shared.allocate<&Header::foos>(2);
+  auto        second = shared.allocate<&Header::foos>(1);
+  EXPECT_EQ(second.index, 4);
+
+  // Reserved but unwritten objects stay hidden
+  reader.refresh();
+  EXPECT_EQ(reader->foos.size(), 2);
+
+  // The second allocation waits for the first, still being written
+  second.objects[0] = {14, 0};
+  std::thread committer([&] { shared.commit<&Header::foos>(second); });
+  first.objects[0] = {12, 1};
+  first.objects[1] = {13, 2};
+  reader.refresh();
+  EXPECT_EQ(reader->foos.size(), 2);
+  shared.commit<&Header::foos>(first);
+  committer.join();
+
+  reader.refresh();
+  bound_header bound(*reader);
+  ASSERT_EQ(reader->foos.size(), 5);
+  EXPECT_EQ(reader->foos[2].bar->data, 21);
+  EXPECT_EQ(reader->foos[4].data, 14);
+  EXPECT_THROW(shared.commit<&Header::foos>(first), std::logic_error);
+}
@@ -0,0 +1,128 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#include <atomic>
+#include <cstdint>
+#include <gtest/gtest.h>
+#include <nodecode/cow_array.hpp>
+#include <nodecode/index_ptr.hpp>
+#include <nodecode/snapshot.hpp>
+#include <ranges>
+#include <thread>
+#include <vector>
+
+using namespace nodecode;
+
+namespace snapshot_test {
+
+struct Node;
+struct Header {
+  cow_array<Node, 4>                               nodes;
+  std::vector<uint32_t>                            values;
+  index_ptr<&Header::values, uint32_t, true>       someValue;
+};
+struct Node {
+  uint32_t                                 value;
+  index_ptr<&Header::nodes, uint32_t, true> next;
+};
+
+// A ring of size nodes where every value equals version
+Header make_ring(uint32_t size, uint32_t version) {
+  Header header;
+  for (uint32_t i = 0; i < size; ++i)
+    header.nodes.push_back({version, (i + 1) % size});
+  header.values    = {10, 20, 30};
+  header.someValue = 2;
+  return header;
+}
+
+} // namespace snapshot_test
+
+using namespace snapshot_test;
+
+TEST(CowArray, SharesChunks) {
+  cow_array<uint32_t, 4> a(100, 7);
+  cow_array<uint32_t, 4> b = a;
+  EXPECT_EQ(b.shared_chunks(), 7);
+  b.mutate(50) = 1;
+  EXPECT_EQ(b.shared_chunks(), 6);
+  EXPECT_EQ(a[50], 7);
+  EXPECT_EQ(b[50], 1);
+  b.push_back(2);
+  EXPECT_EQ(a.size(), 100);
+  EXPECT_EQ(b.size(), 101);
+  EXPECT_EQ(b[100], 2);
+  EXPECT_EQ(b.shared_chunks(), 5);
+  EXPECT_TRUE(std::ranges::equal(a, std::vector<uint32_t>(100, 7)));
+  EXPECT_THROW(b.mutate(101), std::out_of_range);
+}
+
+TEST(Snapshot, ConstHeaderDeref) {
+  const Header header = make_ring(10, 1);
+  EXPECT_EQ(*header.someValue.bind(header), 30);
+  EXPECT_EQ(header.nodes[9].next.bind(header)->next.bind(header)->value, 1);
+  bound_header bound(header);
+  EXPECT_EQ(*header.someValue, 30);
+  EXPECT_EQ(header.nodes[3].next->value, 1);
+}
+
+TEST(Snapshot, PinAndPublish) {
+  versioned_header<Header> versions(make_ring(100, 0));
+  auto                     first = versions.pin();
+  versions.update([](Header& draft) { draft.nodes.mutate(0).value = 1; });
+  auto second = versions.pin();
+  EXPECT_EQ(first->nodes[0].value, 0);
+  EXPECT_EQ(second->nodes[0].value, 1);
+  // Unmodified chunks are shared between the versions
+  EXPECT_EQ(&first->nodes[99], &second->nodes[99]);
+  EXPECT_NE(&first->nodes[0], &second->nodes[0]);
+
+  // first still pins the original version
+  EXPECT_EQ(versions.retired(), 1);
+  first = versions.pin();
+  versions.reclaim();
+  EXPECT_EQ(versions.retired(), 0);
+
+  Header draft = versions.draft();
+  draft.nodes.mutate(1).value = 2;
+  versions.publish(std::move(draft));
+  EXPECT_EQ(second->nodes[1].value, 0);
+  EXPECT_EQ(versions.pin()->nodes[1].value, 2);
+}
+
+TEST(Snapshot, ReadersDuringUpdates) {
+  constexpr uint32_t size = 1000, updates = 2000;
+  versioned_header<Header, 8> versions(make_ring(size, 0));
+  std::atomic<bool>           done = false, bad = false;
+  std::vector<std::thread>    readers;
+  for (int r = 0; r < 4; ++r) {
+    readers.emplace_back([&] {
+      uint32_t last = 0;
+      while (!done) {
+        auto         snapshot = versions.pin();
+        bound_header bound(*snapshot);
+        // Every node of one version holds the same value
+        const Node* node    = &snapshot->nodes[0];
+        uint32_t    version = node->value;
+        for (uint32_t i = 0; i < size; ++i, node = &*node->next)
+          if (node->value != version)
+            bad = true;
+        if (version < last)
+          bad = true;
+        last = version;
+      }
+    });
+  }
+  for (uint32_t v = 1; v <= updates; ++v) {
+    versions.update([v](Header& draft) {
+      for (uint32_t i = 0; i < size; ++i)
+        draft.nodes.mutate(i).value = v;
+    });
+  }
+  done = true;
+  for (auto& reader : readers)
+    reader.join();
+  EXPECT_FALSE(bad);
+  versions.reclaim();
+  EXPECT_EQ(versions.retired(), 0);
+  EXPECT_EQ(versions.pin()->nodes[size - 1].value, updates);
+}
@@ -0,0 +1,89 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#include <algorithm>
+#include <cstdint>
+#include <gtest/gtest.h>
+#include <nodecode/index_ptr.hpp>
+#include <nodecode/soa_index_ptr.hpp>
+#include <numeric>
+#include <span>
+#include <tuple>
+#include <vector>
+
+using namespace nodecode;
+
+namespace soa_index_ptr_test {
+
+struct Header {
+  std::vector<float>    positions;
+  std::vector<float>    velocities;
+  std::vector<uint32_t> ids;
+};
+
+using particle_ptr  = soa_index_ptr<&Header::positions, &Header::velocities,
+                                    &Header::ids>;
+using particle_span = soa_index_span<&Header::positions, &Header::velocities,
+                                     &Header::ids>;
+
+Header make_header(size_t size) {
+  Header header;
+  for (size_t i = 0; i < size; ++i) {
+    header.positions.push_back(float(i));
+    header.velocities.push_back(1.0f);
+    header.ids.push_back(uint32_t(100 + i));
+  }
+  return header;
+}
+
+} // namespace soa_index_ptr_test
+
+using namespace soa_index_ptr_test;
+
+TEST(SoaIndexPtr, Deref) {
+  Header       header = make_header(10);
+  particle_ptr ptr(3);
+  EXPECT_EQ(sizeof(ptr), sizeof(uint32_t));
+  auto particle = ptr.bind(header);
+  EXPECT_EQ(particle.column<&Header::positions>(), 3.0f);
+  EXPECT_EQ(&particle.column<&Header::ids>(), &header.ids[3]);
+
+  bound_header bound(header);
+  auto [position, velocity, id] = *ptr;
+  EXPECT_EQ(id, 103);
+  position += velocity;
+  EXPECT_EQ(header.positions[3], 4.0f);
+  ptr[1] = std::tuple(0.5f, 2.0f, 7u);
+  EXPECT_EQ(header.velocities[4], 2.0f);
+  EXPECT_EQ(header.ids[4], 7);
+  EXPECT_EQ(*ptr.column<&Header::ids>(), 103);
+}
+
+TEST(SoaIndexSpan, Columns) {
+  Header        header = make_header(100);
+  particle_span span(10, 20);
+  auto          bound = span.bind(header);
+  ASSERT_EQ(bound.size(), 20);
+
+  // Columns are plain spans for a vectorized loop
+  std::span<float> positions  = bound.column<&Header::positions>();
+  std::span<float> velocities = bound.column<&Header::velocities>();
+  for (size_t i = 0; i < positions.size(); ++i)
+    positions[i] += velocities[i] * 2.0f;
+  EXPECT_EQ(header.positions[9], 9.0f);
+  EXPECT_EQ(header.positions[10], 12.0f);
+  EXPECT_EQ(header.positions[29], 31.0f);
+  EXPECT_EQ(header.positions[30], 30.0f);
+
+  uint32_t idSum = 0;
+  for (auto particle : bound)
+    idSum += particle.column<&Header::ids>();
+  EXPECT_EQ(idSum, 20 * 100 + (10 + 29) * 20 / 2);
+  EXPECT_EQ(std::ranges::count_if(bound, [](auto particle) {
+              return particle.template column<&Header::positions>() > 20.0f;
+            }),
+            11);
+
+  bound_header bind(header);
+  EXPECT_EQ(span.span()[0].get<2>(), 110);
+  EXPECT_EQ(span.column<&Header::ids>().index(), 10);
+}
@@ -0,0 +1,148 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#include <cstdint>
+#include <cstring>
+#include <gtest/gtest.h>
+#include <nodecode/index_ptr.hpp>
+#include <nodecode/tagged_index_ptr.hpp>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <variant>
+#include <vector>
+
+using namespace nodecode;
+
+namespace tagged_index_ptr_test {
+
+struct Foo;
+struct Bar;
+struct Baz;
+
+struct Header {
+  std::vector<Foo> foos;
+  std::vector<Bar> bars;
+  std::vector<Baz> bazs;
+};
+
+using Any = tagged_index_ptr<&Header::foos, &Header::bars, &Header::bazs>;
+
+struct Foo {
+  std::string name;
+  Any         next;
+};
+
+struct Bar {
+  int value;
+  Any next;
+};
+
+struct Baz {
+  double weight;
+};
+
+} // namespace tagged_index_ptr_test
+
+using namespace tagged_index_ptr_test;
+
+static_assert(sizeof(Any) == sizeof(uint32_t));
+static_assert(Any::tag_bits == 2 && Any::index_bits == 30);
+static_assert(tagged_index_ptr<&Header::foos, &Header::bars>::max_index ==
+              0x7fffffff);
+static_assert(Any(index_ptr<&Header::bars>(5)).tag() == 1);
+static_assert(Any(index_ptr<&Header::bars>(5)).index() == 5);
+
+TEST(TaggedIndexPtr, Tags) {
+  Any foo = index_ptr<&Header::foos>(3);
+  Any baz = index_ptr<&Header::bazs>(Any::max_index);
+  EXPECT_TRUE(foo.holds<&Header::foos>());
+  EXPECT_FALSE(foo.holds<&Header::bars>());
+  EXPECT_EQ(baz.tag(), 2);
+  EXPECT_EQ(baz.index(), Any::max_index);
+  EXPECT_EQ(uint32_t(foo.as<&Header::foos>()), 3);
+  EXPECT_THROW(foo.as<&Header::bazs>(), std::bad_variant_access);
+  EXPECT_THROW(Any(index_ptr<&Header::foos>(Any::max_index + 1)),
+               std::out_of_range);
+  EXPECT_THROW(Any(3, 0), std::out_of_range);
+  EXPECT_EQ(Any(0, 3), foo);
+  EXPECT_EQ(Any().tag(), 0);
+}
+
+TEST(TaggedIndexPtr, Visit) {
+  Header header;
+  header.bazs = {{0.5}};
+  header.bars = {{7, index_ptr<&Header::bazs>(0)}};
+  header.foos = {{"foo0", index_ptr<&Header::bars>(0)}};
+  auto describe = [](auto& object) -> std::string {
+    using T = std::remove_cvref_t<decltype(object)>;
+    if constexpr (std::is_same_v<T, Foo>)
+      return "foo " + object.name;
+    else if constexpr (std::is_same_v<T, Bar>)
+      return "bar " + std::to_string(object.value);
+    else
+      return "baz";
+  };
+  Any start = index_ptr<&Header::foos>(0);
+  EXPECT_EQ(start.visit(header, describe), "foo foo0");
+  EXPECT_EQ(header.foos[0].next.visit(header, describe), "bar 7");
+  bound_header bound(header);
+  EXPECT_EQ(header.bars[0].next.visit(describe), "baz");
+  // References to the target come back out
+  header.bars[0].next.visit([](auto& object) {
+    if constexpr (std::is_same_v<std::remove_cvref_t<decltype(object)>, Baz>)
+      object.weight = 2.0;
+  });
+  EXPECT_EQ(header.bazs[0].weight, 2.0);
+}
+
+TEST(TaggedIndexPtr, Buckets) {
+  Header header;
+  for (int i = 0; i < 4; ++i) {
+    header.foos.push_back({"foo" + std::to_string(i), {}});
+    header.bars.push_back({i * 10, {}});
+  }
+  std::vector<Any> refs{
+      index_ptr<&Header::bars>(2), index_ptr<&Header::foos>(1),
+      index_ptr<&Header::bars>(0), index_ptr<&Header::foos>(3),
+      index_ptr<&Header::bars>(3),
+  };
+  auto buckets = bucket_by_tag(refs);
+  ASSERT_EQ(buckets.bucket<&Header::bars>().size(), 3);
+  EXPECT_EQ(uint32_t(buckets.bucket<&Header::bars>()[1]), 0);
+  EXPECT_EQ(buckets.bucket<&Header::bazs>().size(), 0);
+  EXPECT_EQ(std::vector<size_t>(buckets.positions<&Header::foos>().begin(),
+                                buckets.positions<&Header::foos>().end()),
+            (std::vector<size_t>{1, 3}));
+
+  std::string order;
+  for_each_by_tag(refs, header, [&](auto& object) {
+    using T = std::remove_cvref_t<decltype(object)>;
+    if constexpr (std::is_same_v<T, Foo>)
+      order += object.name + " ";
+    else if constexpr (std::is_same_v<T, Bar>)
+      order += std::to_string(object.value) + " ";
+  });
+  EXPECT_EQ(order, "foo1 foo3 20 0 30 ");
+}
+
+TEST(TaggedIndexPtr, InvalidTag) {
+  // As if mapped from a file: tag 3 fits the tag bits but names no array
+  Any      bad;
+  uint32_t word = 3u << Any::index_bits;
+  std::memcpy(static_cast<void*>(&bad), &word, sizeof(bad));
+  EXPECT_FALSE(bad.valid());
+  EXPECT_TRUE(Any(index_ptr<&Header::bazs>(1)).valid());
+  EXPECT_THROW((void)bad.checked_tag(), std::out_of_range);
+
+  Header header;
+  header.foos = {{"foo0", {}}};
+  EXPECT_THROW(bad.visit(header, [](auto&) {}), std::out_of_range);
+  std::vector<Any> refs{index_ptr<&Header::foos>(0), bad};
+  EXPECT_THROW(bucket_by_tag(refs), std::out_of_range);
+  int calls = 0;
+  EXPECT_THROW(for_each_by_tag(refs, header, [&](auto&) { ++calls; }),
+               std::out_of_range);
+  EXPECT_EQ(calls, 0);
+  // Every tag is valid when the arrays fill the tag bits
+  static_assert(tagged_index_ptr<&Header::foos, &Header::bars>(1, 0).valid());
+}
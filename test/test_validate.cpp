@@ -0,0 +1,123 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#include <cstdint>
+#include <gtest/gtest.h>
+#include <limits>
+#include <nodecode/index_ptr.hpp>
+#include <nodecode/validate.hpp>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace nodecode;
+
+namespace validate_test {
+
+struct Foo;
+
+struct Header {
+  std::vector<Foo>                      foos;
+  std::string                           chars;
+  std::vector<index_ptr<&Header::foos>> roots;
+};
+
+struct Foo {
+  index_ptr<&Header::foos>          next;
+  index_span<&Header::chars>        name;
+  index_span<&Header::chars, uint8_t> tag;
+};
+
+Header make_header(size_t size) {
+  Header header;
+  header.chars = "abcdefghij";
+  for (size_t i = 0; i < size; ++i)
+    header.foos.push_back({uint32_t((i + 1) % size),
+                           {uint32_t(i % 10), uint32_t(10 - i % 10)},
+                           {uint8_t(i % 10), 0}});
+  header.roots = {0, uint32_t(size - 1)};
+  return header;
+}
+
+template <class Header>
+auto validate_all(Header& header) {
+  return validate<index_refs<&Header::foos, &Foo::next>,
+                  index_refs<&Header::foos, &Foo::name>,
+                  index_refs<&Header::foos, &Foo::tag>,
+                  index_refs<&Header::roots>>(header, 1000, 4);
+}
+
+struct WideHeader {
+  std::vector<uint32_t>                                  values;
+  std::vector<index_ptr<&WideHeader::values, uint64_t>>  ptrs;
+  std::vector<index_span<&WideHeader::values, uint64_t>> spans;
+};
+
+template <class Header>
+auto validate_wide(Header& header) {
+  return validate<index_refs<&Header::ptrs>, index_refs<&Header::spans>>(
+      header);
+}
+
+} // namespace validate_test
+
+using namespace validate_test;
+
+TEST(Validate, Valid) {
+  Header header    = make_header(10000);
+  auto   validated = validate_all(header);
+  EXPECT_EQ(&*validated, &header);
+  EXPECT_EQ(validated->foos.size(), 10000);
+}
+
+TEST(Validate, Empty) {
+  Header header;
+  validate<index_refs<&Header::foos, &Foo::next>, index_refs<&Header::roots>>(
+      header);
+}
+
+TEST(Validate, BadPtr) {
+  Header header              = make_header(10000);
+  header.foos[7777].next     = 10000;
+  try {
+    validate_all(header);
+    FAIL();
+  } catch (const std::out_of_range& e) {
+    EXPECT_NE(std::string(e.what()).find("element 7777"), std::string::npos);
+  }
+  header.foos[7777].next = 9999;
+  header.roots.push_back(10000);
+  EXPECT_THROW(validate_all(header), std::out_of_range);
+}
+
+TEST(Validate, BadSpan) {
+  Header header = make_header(100);
+  // Ends exactly at the end is fine, one more is not
+  header.foos[42].name = {4, 6};
+  validate_all(header);
+  header.foos[42].name = {4, 7};
+  EXPECT_THROW(validate_all(header), std::out_of_range);
+  header.foos[42].name = {10, 0};
+  validate_all(header);
+  header.foos[42].name = {0xffffffffu, 2};
+  EXPECT_THROW(validate_all(header), std::out_of_range);
+}
+
+TEST(Validate, WideIndices) {
+  // uint64_t index + 1 or index + size wraps to a small value and must still
+  // be rejected
+  constexpr uint64_t max = std::numeric_limits<uint64_t>::max();
+  WideHeader         header;
+  header.values.resize(10);
+  header.ptrs  = {0, 9};
+  header.spans = {{0, 10}, {10, 0}};
+  validate_wide(header);
+  header.ptrs.push_back(max);
+  EXPECT_THROW(validate_wide(header), std::out_of_range);
+  header.ptrs.pop_back();
+  header.spans.push_back({max, 2});
+  EXPECT_THROW(validate_wide(header), std::out_of_range);
+  header.spans.back() = {2, max};
+  EXPECT_THROW(validate_wide(header), std::out_of_range);
+  header.spans.back() = {max, 0};
+  EXPECT_THROW(validate_wide(header), std::out_of_range);
+}